@@ -0,0 +1,67 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Grows the same plant with each light model for an increasing number of
+cycles. The time spent on light and the shape of the result (number of stems
+and the position of the trunk tip) show what shadow propagation trades for
+speed. */
+
+#include "plant_generator/generator.h"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace pg;
+
+int countStems(const Stem *stem)
+{
+	int count = 0;
+	while (stem) {
+		count += 1 + countStems(stem->getChild());
+		stem = stem->getSibling();
+	}
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	int maxCycles = argc > 1 ? std::atoi(argv[1]) : 8;
+	const char *names[2] = {"rays", "shadows"};
+	const Generator::LightModel models[2] = {
+		Generator::RayCasting, Generator::ShadowPropagation};
+
+	std::printf("%-8s %6s %8s %10s %10s %10s %10s\n", "light", "cycles",
+		"stems", "tip x", "tip y", "tip z", "light (s)");
+	for (int cycles = 2; cycles <= maxCycles; cycles += 2) {
+		for (int i = 0; i < 2; i++) {
+			Plant plant;
+			plant.setDefault();
+			Generator generator(&plant);
+			generator.lightModel = models[i];
+			generator.cycles = cycles;
+			generator.grow();
+
+			const Stem *root = plant.getRoot();
+			const Path &path = root->getPath();
+			Vec3 tip = path.get(path.getSize() - 1);
+			tip += root->getLocation();
+			double time = generator.getTime(Generator::CastRays);
+			std::printf(
+				"%-8s %6d %8d %10.4f %10.4f %10.4f %10.4f\n",
+				names[i], cycles, countStems(root),
+				tip.x, tip.y, tip.z, time);
+		}
+	}
+	return 0;
+}
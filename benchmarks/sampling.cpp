@@ -0,0 +1,87 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Grows the same plant with several seeds for each sampling method and ray
+count. The seed only changes which rays are cast, so the spread of the trunk
+tips between seeds shows how stable the growth is. */
+
+#include "plant_generator/generator.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace pg;
+
+const int seeds = 8;
+
+struct Result {
+	float spread;
+	float variance;
+	double time;
+};
+
+Result grow(Generator::Sampling sampling, int rays, int cycles)
+{
+	Result result = {0.0f, 0.0f, 0.0};
+	Vec3 tips[seeds];
+	Vec3 mean(0.0f, 0.0f, 0.0f);
+	for (int seed = 0; seed < seeds; seed++) {
+		Plant plant;
+		plant.setDefault();
+		Generator generator(&plant);
+		generator.sampling = sampling;
+		generator.rays = rays;
+		generator.cycles = cycles;
+		generator.seed = seed;
+		auto start = std::chrono::steady_clock::now();
+		generator.grow();
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double, std::milli> time = end - start;
+		result.time += time.count() / seeds;
+		result.variance += generator.getFluxVariance() / seeds;
+
+		const Stem *root = plant.getRoot();
+		const Path &path = root->getPath();
+		tips[seed] = root->getLocation() + path.get(path.getSize() - 1);
+		mean += tips[seed] / seeds;
+	}
+	for (int seed = 0; seed < seeds; seed++) {
+		Vec3 difference = tips[seed] - mean;
+		result.spread += dot(difference, difference) / seeds;
+	}
+	result.spread = std::sqrt(result.spread);
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	int cycles = argc > 1 ? std::atoi(argv[1]) : 3;
+	const char *names[3] = {"random", "stratified", "sobol"};
+	const Generator::Sampling samplings[3] = {
+		Generator::Random, Generator::Stratified, Generator::Sobol};
+
+	std::printf("%-12s %8s %12s %12s %10s\n",
+		"sampling", "rays", "tip spread", "variance", "time (ms)");
+	for (int i = 0; i < 3; i++) {
+		for (int rays = 256; rays <= 16384; rays *= 2) {
+			Result result = grow(samplings[i], rays, cycles);
+			std::printf("%-12s %8d %12.6f %12.6f %10.1f\n",
+				names[i], rays, result.spread,
+				result.variance, result.time);
+		}
+	}
+	return 0;
+}
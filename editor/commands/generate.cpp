@@ -26,7 +26,8 @@ Generate::Generate(Selection *selection, pg::PatternGenerator *generator) :
 	prevSelection(*selection),
 	removals(selection->getPlant()),
 	remove(&removals),
-	generator(generator)
+	generator(generator),
+	grown(false)
 {
 	createRemovalSelection(this->selection, &this->removals);
 	this->remove.execute();
@@ -61,31 +62,41 @@ void Generate::createRemovalSelection(Selection *selection, Selection *removals)
 
 void Generate::removeAdditions()
 {
-	Plant *plant = this->selection->getPlant();
 	auto instances = this->selection->getStemInstances();
-	for (auto it = instances.rbegin(); it != instances.rend(); it++) {
-		Stem *stem = it->first;
-		for (int i = stem->getLeafCount() - 1; i >= 0; i--)
-			if (!stem->getLeaf(i)->isCustom())
-				stem->removeLeaf(i);
+	for (auto it = instances.rbegin(); it != instances.rend(); it++)
+		removeAdditions(it->first);
+}
 
-		Stem *child = stem->getChild();
-		while (child) {
-			Stem *sibling = child->getSibling();
-			if (!child->isCustom())
-				plant->deleteStem(child);
-			child = sibling;
-		}
+void Generate::removeAdditions(Stem *stem)
+{
+	Plant *plant = this->selection->getPlant();
+	for (int i = stem->getLeafCount() - 1; i >= 0; i--)
+		if (!stem->getLeaf(i)->isCustom())
+			stem->removeLeaf(i);
+
+	Stem *child = stem->getChild();
+	while (child) {
+		Stem *sibling = child->getSibling();
+		if (!child->isCustom())
+			plant->deleteStem(child);
+		child = sibling;
 	}
 }
 
 void Generate::execute()
 {
 	this->selection->reduceToAncestors();
-	removeAdditions();
 	auto instances = this->selection->getStemInstances();
-	for (auto instance : instances)
-		this->generator->grow(instance.first);
+	for (auto instance : instances) {
+		Stem *stem = instance.first;
+		/* Once the stems are grown, only the stems of changed parameter
+		nodes are grown again. */
+		if (!this->grown || !this->generator->update(stem)) {
+			removeAdditions(stem);
+			this->generator->grow(stem);
+		}
+	}
+	this->grown = true;
 }
 
 void Generate::undo()
@@ -104,6 +115,7 @@ void Generate::undo()
 	removeAdditions();
 	this->remove.undo();
 	*this->selection = this->prevSelection;
+	this->grown = false;
 }
 
 void Generate::redo()
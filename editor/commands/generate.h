@@ -32,9 +32,11 @@ class Generate : public Command {
 	std::vector<pg::ParameterTree> parameterTrees;
 	pg::ParameterTree parameterTree;
 	pg::PatternGenerator *generator;
+	bool grown;
 
 	void createRemovalSelection(Selection *, Selection *);
 	void removeAdditions();
+	void removeAdditions(pg::Stem *stem);
 
 public:
 	Generate(Selection *selection, pg::PatternGenerator *generator);
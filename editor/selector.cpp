@@ -45,7 +45,7 @@ bool Selector::selectPoint(const QMouseEvent *event, Selection *selection)
 	for (auto &instance : selection->getStemInstances()) {
 		Stem *stem = instance.first;
 		PointSelection &ps = instance.second;
-		Spline spline = stem->getPath().getSpline();
+		const Spline &spline = stem->getPath().getSpline();
 		Vec3 location = stem->getLocation();
 		point = selectPoint(event, spline, location, &ps);
 		if (point >= 0) {
@@ -95,7 +95,7 @@ pair<float, Stem *> Selector::getStem(pg::Ray ray, Stem *stem, Plant *plant)
 	pair<float, Stem *> selection2(max, nullptr);
 
 	if (stem != nullptr) {
-		Path path = stem->getPath();
+		const Path &path = stem->getPath();
 		for (size_t i = 0, j = 1; i < path.getSize()-1; i++, j++) {
 			Vec3 direction = path.getDirection(i);
 			Vec3 line[2] = {path.get(i), path.get(j)};
@@ -170,7 +170,7 @@ int Selector::selectPoint(const QMouseEvent *event, const Spline &spline,
 	Vec3 location, PointSelection *selection)
 {
 	bool ctrl = event->modifiers() & Qt::ControlModifier;
-	auto controls = spline.getControls();
+	const std::vector<Vec3> &controls = spline.getControls();
 	int size = controls.size();
 	int degree = spline.getDegree();
 	int selectedPoint = -1;
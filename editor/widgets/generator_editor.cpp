@@ -31,8 +31,12 @@ GeneratorEditor::GeneratorEditor(Editor *editor, QWidget *parent) :
 		this->workload, &QObject::deleteLater);
 	connect(this, &GeneratorEditor::generate,
 		this->workload, &GeneratorWorkload::generate);
+	connect(this, &GeneratorEditor::extendGrowth,
+		this->workload, &GeneratorWorkload::extend);
 	connect(this->workload, &GeneratorWorkload::done,
 		this, &GeneratorEditor::end);
+	connect(this->workload, &GeneratorWorkload::progress,
+		this, &GeneratorEditor::updateProgress);
 	this->thread.start();
 }
 
@@ -75,12 +79,29 @@ void GeneratorEditor::createInterface()
 	form->addRow("Nodes", this->iv[Nodes]);
 	this->iv[Rays]->setRange(0, 100000);
 	form->addRow("Rays", this->iv[Rays]);
+	this->sampling = new ComboBox(this);
+	this->sampling->addItem("Random");
+	this->sampling->addItem("Stratified");
+	this->sampling->addItem("Sobol");
+	form->addRow("Sampling", this->sampling);
+	this->dv[Tolerance]->setRange(0.0f, 1.0f);
+	form->addRow("Ray Tolerance", this->dv[Tolerance]);
 	this->iv[Depth]->setRange(-10, 10);
 	form->addRow("Volume Depth", this->iv[Depth]);
+	this->voxelization = new ComboBox(this);
+	this->voxelization->addItem("Lines");
+	this->voxelization->addItem("Capsules");
+	form->addRow("Voxelization", this->voxelization);
+	this->lightModel = new ComboBox(this);
+	this->lightModel->addItem("Ray Casting");
+	this->lightModel->addItem("Shadow Propagation");
+	form->addRow("Light", this->lightModel);
 	this->dv[Optimization]->setRange(0.0f, 1.0f);
 	form->addRow("Optimization", this->dv[Optimization]);
 	this->iv[Seed]->setRange(min, max);
 	form->addRow("Seed", this->iv[Seed]);
+	this->iv[Threads]->setRange(1, 256);
+	form->addRow("Threads", this->iv[Threads]);
 	setFormLayout(form);
 	setValues();
 	layout->addWidget(group);
@@ -88,6 +109,15 @@ void GeneratorEditor::createInterface()
 	form = createForm(group);
 	this->startButton = new QPushButton("Erase && Generate", this);
 	form->addRow(this->startButton);
+	this->extendButton = new QPushButton("Extend", this);
+	this->extendButton->setEnabled(false);
+	form->addRow(this->extendButton);
+	this->cancelButton = new QPushButton("Cancel", this);
+	this->cancelButton->setEnabled(false);
+	form->addRow(this->cancelButton);
+	this->progressBar = new QProgressBar(this);
+	this->progressBar->setValue(0);
+	form->addRow(this->progressBar);
 	this->toggleVolumeButton = new QPushButton("Toggle Volume", this);
 	form->addRow(this->toggleVolumeButton);
 	setFormLayout(form);
@@ -102,9 +132,23 @@ void GeneratorEditor::createInterface()
 		connect(this->iv[i],
 			QOverload<int>::of(&SpinBox::valueChanged),
 			this, &GeneratorEditor::change);
+	connect(this->sampling,
+		QOverload<int>::of(&ComboBox::currentIndexChanged),
+		this, &GeneratorEditor::change);
+	connect(this->voxelization,
+		QOverload<int>::of(&ComboBox::currentIndexChanged),
+		this, &GeneratorEditor::change);
+	connect(this->lightModel,
+		QOverload<int>::of(&ComboBox::currentIndexChanged),
+		this, &GeneratorEditor::change);
 
 	connect(this->startButton, &QPushButton::clicked,
 		this, &GeneratorEditor::start);
+	connect(this->extendButton, &QPushButton::clicked,
+		this, &GeneratorEditor::extend);
+	connect(this->cancelButton, &QPushButton::clicked, [&] () {
+		this->editor->getScene()->generator.cancel();
+	});
 	connect(this->toggleVolumeButton, &QPushButton::clicked, [&] () {
 		this->editor->displayVolume(!this->editor->showingVolume());
 		this->editor->change();
@@ -121,11 +165,16 @@ void GeneratorEditor::setValues()
 	this->dv[SynthesisRate]->setValue(g->synthesisRate);
 	this->dv[SynthesisThreshold]->setValue(g->synthesisThreshold);
 	this->dv[Optimization]->setValue(g->optimization);
+	this->dv[Tolerance]->setValue(g->tolerance);
 	this->iv[Cycles]->setValue(g->cycles);
 	this->iv[Nodes]->setValue(g->nodes);
 	this->iv[Rays]->setValue(g->rays);
 	this->iv[Depth]->setValue(g->depth);
 	this->iv[Seed]->setValue(g->seed);
+	this->iv[Threads]->setValue(g->threads);
+	this->sampling->setCurrentIndex(g->sampling);
+	this->voxelization->setCurrentIndex(g->voxelization);
+	this->lightModel->setCurrentIndex(g->lightModel);
 }
 
 void GeneratorEditor::change()
@@ -138,28 +187,66 @@ void GeneratorEditor::change()
 	g->synthesisThreshold = this->dv[SynthesisThreshold]->value();
 	g->synthesisRate = this->dv[SynthesisRate]->value();
 	g->optimization = this->dv[Optimization]->value();
+	g->tolerance = this->dv[Tolerance]->value();
 	g->rays = this->iv[Rays]->value();
 	g->cycles = this->iv[Cycles]->value();
 	g->nodes = this->iv[Nodes]->value();
 	g->depth = this->iv[Depth]->value();
 	g->seed = this->iv[Seed]->value();
+	g->threads = this->iv[Threads]->value();
+	g->sampling = static_cast<Generator::Sampling>(
+		this->sampling->currentIndex());
+	g->voxelization = static_cast<Generator::Voxelization>(
+		this->voxelization->currentIndex());
+	g->lightModel = static_cast<Generator::LightModel>(
+		this->lightModel->currentIndex());
 }
 
 void GeneratorEditor::start()
 {
+	Generator *g = &this->editor->getScene()->generator;
+	this->progressBar->setRange(0, g->cycles * g->nodes);
+	this->progressBar->setValue(0);
 	this->startButton->setEnabled(false);
+	this->extendButton->setEnabled(false);
+	this->cancelButton->setEnabled(true);
 	emit reset();
 	this->editor->getScene()->updating = true;
 	emit generate();
 }
 
+/** Grow the cycles that were added since the plant was generated. Pruning
+deletes stems, so the selection and history are cleared first. The plant is
+kept, unlike when growth is started again. */
+void GeneratorEditor::extend()
+{
+	Generator *g = &this->editor->getScene()->generator;
+	this->progressBar->setRange(0, g->cycles * g->nodes);
+	this->progressBar->setValue(g->getCycle() * g->nodes);
+	this->startButton->setEnabled(false);
+	this->extendButton->setEnabled(false);
+	this->cancelButton->setEnabled(true);
+	this->editor->reset();
+	this->editor->getScene()->updating = true;
+	emit extendGrowth();
+}
+
 void GeneratorEditor::end()
 {
+	Generator *g = &this->editor->getScene()->generator;
 	this->startButton->setEnabled(true);
+	this->extendButton->setEnabled(g->getCycle() > 0);
+	this->cancelButton->setEnabled(false);
 	this->editor->getScene()->updating = false;
 	this->editor->change();
 }
 
+void GeneratorEditor::updateProgress(int cycle, int node)
+{
+	Generator *g = &this->editor->getScene()->generator;
+	this->progressBar->setValue(cycle * g->nodes + node);
+}
+
 GeneratorWorkload::GeneratorWorkload(Scene *scene) : scene(scene)
 {
 
@@ -167,6 +254,19 @@ GeneratorWorkload::GeneratorWorkload(Scene *scene) : scene(scene)
 
 void GeneratorWorkload::generate()
 {
+	this->scene->generator.progress = [&] (int cycle, int node) {
+		emit progress(cycle, node);
+	};
 	this->scene->generator.grow();
 	emit done();
 }
+
+void GeneratorWorkload::extend()
+{
+	this->scene->generator.progress = [&] (int cycle, int node) {
+		emit progress(cycle, node);
+	};
+	this->scene->generator.resume();
+	while (this->scene->generator.growCycle());
+	emit done();
+}
@@ -31,9 +31,11 @@ public:
 
 public slots:
 	void generate();
+	void extend();
 
 signals:
 	void done();
+	void progress(int cycle, int node);
 };
 
 class GeneratorEditor : public QWidget {
@@ -44,13 +46,20 @@ class GeneratorEditor : public QWidget {
 	GeneratorWorkload *workload;
 
 	enum {PrimaryRate, SecondaryRate, Suppression, SuppressionFalloff,
-		SynthesisThreshold, SynthesisRate, Optimization, DSize};
-	enum {Cycles, Nodes, Rays, Depth, Seed, ISize};
+		SynthesisThreshold, SynthesisRate, Optimization, Tolerance,
+		DSize};
+	enum {Cycles, Nodes, Rays, Depth, Seed, Threads, ISize};
 
 	QPushButton *startButton;
+	QPushButton *extendButton;
+	QPushButton *cancelButton;
 	QPushButton *toggleVolumeButton;
+	QProgressBar *progressBar;
 	SpinBox *iv[ISize];
 	DoubleSpinBox *dv[DSize];
+	ComboBox *sampling;
+	ComboBox *voxelization;
+	ComboBox *lightModel;
 
 	void createInterface();
 	void setValues();
@@ -62,10 +71,13 @@ public:
 
 public slots:
 	void start();
+	void extend();
 	void end();
+	void updateProgress(int cycle, int node);
 
 signals:
 	void generate();
+	void extendGrowth();
 	void reset();
 };
 
@@ -352,8 +352,8 @@ void PatternEditor::setFields()
 	auto instances = this->editor->getSelection()->getStemInstances();
 	if (!instances.empty()) {
 		Stem *stem = instances.begin()->first;
-		ParameterTree tree = stem->getParameterTree();
-		ParameterNode *root = tree.getRoot();
+		const ParameterTree &tree = stem->getParameterTree();
+		const ParameterNode *root = tree.getRoot();
 		if (tree.get(this->name))
 			setFields(tree, this->name);
 		else if (root)
@@ -375,7 +375,7 @@ void PatternEditor::setFields(const ParameterTree &tree, string name)
 	} else
 		this->nodeValue->addItem("");
 
-	ParameterNode *node = name == "" ? nullptr : tree.get(name);
+	const ParameterNode *node = name == "" ? nullptr : tree.get(name);
 	if (node) {
 		this->nodeValue->setCurrentText(QString::fromStdString(name));
 		setStemData(node->getData());
@@ -391,11 +391,6 @@ void PatternEditor::change()
 		return;
 
 	createCommand();
-	Stem *stem = instances.begin()->first;
-	ParameterTree tree = stem->getParameterTree();
-	if (!tree.getRoot())
-		tree.createRoot();
-
 	this->generate->execute();
 	this->editor->change();
 }
@@ -445,7 +440,7 @@ void PatternEditor::select()
 	auto instances = this->editor->getSelection()->getStemInstances();
 	if (!instances.empty()) {
 		Stem *stem = instances.begin()->first;
-		ParameterTree tree = stem->getParameterTree();
+		const ParameterTree &tree = stem->getParameterTree();
 		this->name = this->nodeValue->currentText().toStdString();
 		setFields(tree, this->name);
 	}
@@ -460,7 +455,7 @@ void PatternEditor::addChildNode()
 	createCommand();
 	Stem *stem = instances.begin()->first;
 	ParameterTree tree = stem->getParameterTree();
-	if (!tree.getRoot())
+	if (!stem->getParameterTree().getRoot())
 		tree.createRoot();
 
 	if (this->nodeValue->currentIndex() == 0) {
@@ -580,7 +575,7 @@ void PatternEditor::setCurveFields()
 	}
 
 	Stem *stem = instances.begin()->first;
-	ParameterTree tree = stem->getParameterTree();
+	const ParameterTree &tree = stem->getParameterTree();
 	std::vector<string> names = tree.getNames();
 	this->curveNode->clear();
 	this->curveNode->addItem("");
@@ -602,11 +597,11 @@ void PatternEditor::selectCurve()
 	Spline spline;
 	int index = this->curveType->currentIndex();
 	Stem *stem = instances.begin()->first;
-	ParameterTree tree = stem->getParameterTree();
+	const ParameterTree &tree = stem->getParameterTree();
 
 	if (this->curveNode->currentIndex() > 0) {
 		string name = this->curveNode->currentText().toStdString();
-		ParameterNode *node = tree.get(name);
+		const ParameterNode *node = tree.get(name);
 		if (index == 0)
 			spline = node->getData().densityCurve;
 		else if (index == 1)
@@ -647,24 +642,21 @@ void PatternEditor::updateParameterTree(Spline spline)
 		int index = this->curveType->currentIndex();
 		Stem *stem = instance.first;
 		ParameterTree tree = stem->getParameterTree();
-		if (!tree.getRoot())
+		/* The nodes are only copied if the curve is changed. */
+		ParameterNode *node = tree.get(name);
+		if (!node)
 			continue;
 
-		if (this->curveNode->currentIndex() > 0) {
-			ParameterNode *node = tree.get(name);
-			if (!node)
-				continue;
-			StemData data = node->getData();
-			if (index == 0)
-				data.densityCurve = spline;
-			else if (index == 1)
-				data.inclineCurve = spline;
-			else if (index == 2)
-				data.lengthCurve = spline;
-			else
-				data.leaf.densityCurve = spline;
-			node->setData(data);
-			stem->setParameterTree(tree);
-		}
+		StemData data = node->getData();
+		if (index == 0)
+			data.densityCurve = spline;
+		else if (index == 1)
+			data.inclineCurve = spline;
+		else if (index == 2)
+			data.lengthCurve = spline;
+		else
+			data.leaf.densityCurve = spline;
+		node->setData(data);
+		stem->setParameterTree(tree);
 	}
 }
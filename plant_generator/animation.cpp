@@ -42,7 +42,7 @@ std::vector<KeyFrame> Animation::getFrame(int ticks, Stem *stem)
 
 void Animation::createFrame(float t, size_t index1, size_t index2, Stem *stem)
 {
-	const std::vector<Joint> joints = stem->getJoints();
+	const std::vector<Joint> &joints = stem->getJoints();
 	for (const Joint &joint : joints) {
 		size_t jointIndex = joint.getID();
 		size_t parentJointIndex = joint.getParentID();
@@ -24,17 +24,17 @@ Curve::Curve()
 
 Curve::Curve(int type) : spline(type)
 {
-
+	this->spline.compile();
 }
 
 Curve::Curve(Spline spline) : spline(spline)
 {
-
+	this->spline.compile();
 }
 
 Curve::Curve(Spline spline, std::string name) : spline(spline), name(name)
 {
-
+	this->spline.compile();
 }
 
 void Curve::setName(std::string name)
@@ -50,9 +50,10 @@ std::string Curve::getName() const
 void Curve::setSpline(Spline spline)
 {
 	this->spline = spline;
+	this->spline.compile();
 }
 
-Spline Curve::getSpline() const
+const Spline &Curve::getSpline() const
 {
 	return this->spline;
 }
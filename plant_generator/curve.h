@@ -35,6 +35,8 @@ namespace pg {
 		{
 			ar & spline;
 			ar & name;
+			if (Archive::is_loading::value)
+				spline.compile();
 		}
 #endif
 
@@ -45,8 +47,9 @@ namespace pg {
 		Curve(Spline spline, std::string name);
 		void setName(std::string name);
 		std::string getName() const;
+		/** Set the spline and compile it for faster lookups. */
 		void setSpline(Spline spline);
-		Spline getSpline() const;
+		const Spline &getSpline() const;
 	};
 }
 
@@ -404,8 +404,8 @@ void setAnimations(XMLWriter &xml, const Animation &animation)
 /** Create a list of bind poses that is ordered by joint ID.*/
 void getJointPoses(const Stem *stem, vector<Vec3> &poses, vector<int> &ids)
 {
-	vector<Joint> joints = stem->getJoints();
-	for (Joint joint : joints) {
+	const vector<Joint> &joints = stem->getJoints();
+	for (const Joint &joint : joints) {
 		Vec3 location = joint.getLocation() + stem->getLocation();
 		int id = joint.getID();
 		auto it = std::upper_bound(ids.begin(), ids.end(), id);
@@ -540,8 +540,8 @@ void setControllers(XMLWriter &xml, const Mesh &mesh, const Plant &plant)
 
 void addJoints(XMLWriter &xml, const Stem *stem, Vec3 prevLocation)
 {
-	std::vector<Joint> joints = stem->getJoints();
-	for (Joint joint : joints) {
+	const std::vector<Joint> &joints = stem->getJoints();
+	for (const Joint &joint : joints) {
 		int id = joint.getID();
 		xml >> ("<node type='JOINT' "
 			"id='plant-armature-joint" + toString(id) + "' "
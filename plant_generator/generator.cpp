@@ -14,8 +14,11 @@
  */
 
 #include "generator.h"
+#include <algorithm>
+#include <array>
 #include <cmath>
 #include <limits>
+#include <unordered_map>
 
 using namespace pg;
 using std::cos;
@@ -23,10 +26,65 @@ using std::sin;
 using std::vector;
 
 const float pi = 3.14159265359f;
+/* Rays are cast in fixed size batches so that the random numbers assigned to
+a ray do not depend on the number of threads. */
+const int raysPerBatch = 256;
+/* With a tolerance, the flux is first compared after this many batches and
+then each time the number of batches doubles. */
+const int firstCheckpoint = 2;
+/* The tree layout of the volume is generalized in parallel below this depth.
+The linear layout is generalized in parallel in chunks of nodes. */
+const int splitDepth = 2;
+const size_t nodesPerChunk = 1024;
+/* Shadows are propagated through a grid with at most this depth. */
+const int maxShadowDepth = 6;
+
+void generalizeDensity(Volume::Node *);
+void generalizeFlux(Volume::Node *);
+
+/* Return a point of a four dimensional Sobol sequence. The direction numbers
+are from the primitive polynomials 1, x+1, x^2+x+1, and x^3+x+1 listed by
+Joe and Kuo. */
+uint32_t getSobolSample(uint32_t index, int dimension)
+{
+	typedef std::array<std::array<uint32_t, 32>, 4> Directions;
+	static const Directions directions = [] {
+		const int degrees[4] = {0, 1, 2, 3};
+		const int coefficients[4] = {0, 0, 1, 1};
+		const uint32_t m[4][3] = {{0}, {1}, {1, 3}, {1, 3, 1}};
+		Directions directions;
+		for (int k = 0; k < 32; k++)
+			directions[0][k] = (uint32_t)1 << (31-k);
+		for (int d = 1; d < 4; d++) {
+			int s = degrees[d];
+			uint32_t *v = directions[d].data();
+			for (int k = 0; k < s; k++)
+				v[k] = m[d][k] << (31-k);
+			for (int k = s; k < 32; k++) {
+				v[k] = v[k-s] ^ (v[k-s] >> s);
+				for (int i = 1; i < s; i++)
+					if ((coefficients[d] >> (s-1-i)) & 1)
+						v[k] ^= v[k-i];
+			}
+		}
+		return directions;
+	}();
+
+	uint32_t sample = 0;
+	for (int bit = 0; index; index >>= 1, bit++)
+		if (index & 1)
+			sample ^= directions[dimension][bit];
+	return sample;
+}
 
 Generator::Generator(Plant *plant) :
 	plant(plant),
 	width(0.0f),
+	rebuildVolume(true),
+	cycle(0),
+	iteration(0),
+	prepared(false),
+	fluxVariance(0.0f),
 	primaryGrowthRate(0.5f),
 	secondaryGrowthRate(0.005f),
 	minRadius(0.001f),
@@ -39,110 +97,708 @@ Generator::Generator(Plant *plant) :
 	rays(10000),
 	cycles(5),
 	nodes(4),
-	seed(0)
+	seed(0),
+	threads(1),
+	layout(Volume::Tree),
+	sampling(Random),
+	voxelization(Lines),
+	lightModel(RayCasting),
+	tolerance(0.0f),
+	compact(false),
+	estimateVariance(false)
 {
+	std::fill(this->times, this->times + Phases, 0.0);
+	this->cancelled = false;
+}
 
+/** Run a loop on the threads of the pool, which is created again when the
+number of threads changes. */
+void Generator::parallelFor(size_t count,
+	std::function<void(size_t)> function)
+{
+	int threads = std::max(this->threads, 1);
+	if (!this->pool || this->pool->getThreads() != threads)
+		this->pool.reset(new TaskPool(threads));
+	this->pool->parallelFor(count, function);
 }
 
 void Generator::grow()
+{
+	start();
+	while (growCycle());
+}
+
+void Generator::grow(const std::vector<Plant *> &plants,
+	const std::vector<Vec3> &positions)
+{
+	start(plants, positions);
+	while (growCycle());
+}
+
+void Generator::start()
+{
+	start({this->plant}, {Vec3(0.0f, 0.0f, 0.0f)});
+}
+
+void Generator::start(const std::vector<Plant *> &plants,
+	const std::vector<Vec3> &positions)
 {
 	this->mt.seed(this->seed);
 	this->width = 1.0f;
-	Stem *root = createRoot();
-	for (int i = 0; i < this->cycles; i++) {
-		if (i > 0) {
-			evaluateEfficiency(&this->volume, root);
-			addStems(root, &this->volume);
+	this->volume.setLayout(this->layout);
+	this->rebuildVolume = true;
+	this->cycle = 0;
+	this->iteration = 0;
+	this->prepared = false;
+	this->rayCounts.clear();
+	this->cancelled = false;
+	std::fill(this->times, this->times + Phases, 0.0);
+	this->instances.clear();
+	for (size_t i = 0; i < plants.size(); i++) {
+		Vec3 position(0.0f, 0.0f, 0.0f);
+		if (i < positions.size())
+			position = positions[i];
+		this->instances.push_back({plants[i], this->width, false, {}});
+		createRoot(this->instances.back(), position);
+	}
+	updateInstances();
+}
+
+bool Generator::growCycle()
+{
+	if (this->instances.empty() || this->cycle >= this->cycles ||
+		this->cancelled)
+		return false;
+
+	const size_t size = this->instances.size();
+	Clock::time_point time = Clock::now();
+	if (!this->prepared) {
+		this->rayCounts.resize(this->cycle + 1);
+		this->rayCounts.back() = 0;
+		if (this->cycle > 0) {
+			removeInefficientStems();
+			updateInstances();
+			time = addTime(EvaluateEfficiency, time);
+			parallelFor(size, [&](size_t k) {
+				Instance &instance = this->instances[k];
+				Stem *root = instance.plant->getRoot();
+				addStems(instance, root, &this->volume);
+			});
+			updateInstances();
+			time = addTime(AddNodes, time);
 		}
+		this->prepared = true;
+	}
 
-		for (int j = 0; j < this->nodes; j++) {
-			int depth = std::log2(this->width) + this->depth;
-			if (depth <= 0)
-				depth = 1;
-			this->volume.clear(this->width*2.0f, depth);
-			addToVolume(&this->volume, root);
-			generalizeDensity(this->volume.getRoot());
-			setConcentration(root);
-			castRays(&this->volume);
-			generalizeFlux(this->volume.getRoot());
-			addNodes(&this->volume, root);
+	while (this->iteration < this->nodes) {
+		/* An iteration that is cancelled before stems grow is repeated
+		with the same random numbers. Adding segments and casting the
+		same rays again leaves the volume as it would have been. */
+		std::mt19937 mt = this->mt;
+		int rayCount = this->rayCounts.back();
+		updateVolume();
+		time = addTime(AddToVolume, time);
+		generalize(&this->volume, generalizeDensity);
+		time = addTime(Generalize, time);
+		if (this->cancelled)
+			break;
+		if (this->lightModel == ShadowPropagation)
+			propagateShadows(&this->volume);
+		else
+			this->rayCounts.back() += castRays(&this->volume);
+		time = addTime(CastRays, time);
+		generalize(&this->volume, generalizeFlux);
+		time = addTime(Generalize, time);
+		if (this->cancelled) {
+			this->mt = mt;
+			this->rayCounts.back() = rayCount;
+			break;
 		}
+		parallelFor(size, [&](size_t k) {
+			Instance &instance = this->instances[k];
+			Stem *root = instance.plant->getRoot();
+			setConcentration(root);
+			addNodes(&this->volume, instance, root);
+		});
+		updateInstances();
+		time = addTime(AddNodes, time);
+		this->iteration++;
+		if (this->progress)
+			this->progress(this->cycle, this->iteration);
+		if (this->cancelled)
+			break;
 	}
+	if (this->cancelled)
+		return false;
+	this->iteration = 0;
+	this->prepared = false;
+	this->cycle++;
+	return true;
+}
+
+int Generator::getCycle() const
+{
+	return this->cycle;
 }
 
-Stem *Generator::createRoot()
+/** Append the state of each stem in depth-first order. */
+void Generator::getStates(const Stem *stem,
+	std::vector<GeneratorState> &states) const
+{
+	while (stem) {
+		states.push_back(*stem->getState());
+		getStates(stem->getChild(), states);
+		stem = stem->getSibling();
+	}
+}
+
+void Generator::setStates(Stem *stem,
+	const std::vector<GeneratorState> &states, size_t &index)
+{
+	while (stem && index < states.size()) {
+		*stem->getState() = states[index++];
+		setStates(stem->getChild(), states, index);
+		stem = stem->getSibling();
+	}
+}
+
+/** Add the time since the start of a phase and return the current time. */
+Generator::Clock::time_point Generator::addTime(Phase phase,
+	Clock::time_point start)
+{
+	Clock::time_point time = Clock::now();
+	std::chrono::duration<double> duration = time - start;
+	this->times[phase] += duration.count();
+	return time;
+}
+
+void Generator::createRoot(Instance &instance, Vec3 position)
 {
 	Path path;
 	Spline spline;
+	Vec3 height(0.0f, 0.0f, this->primaryGrowthRate/2.0f);
 	std::vector<Vec3> controls;
-	controls.push_back(Vec3(0.0f, 0.0f, 0.0f));
-	controls.push_back(Vec3(0.0f, 0.0f, this->primaryGrowthRate/2.0f));
+	controls.push_back(position);
+	controls.push_back(position + height);
 	spline.setControls(controls);
 	spline.setDegree(1);
-	path.setSpline(spline);
+	path.setSpline(std::move(spline));
 
-	Stem *root = this->plant->createRoot();
-	root->setPath(path);
+	Stem *root = instance.plant->createRoot();
+	root->setPath(std::move(path));
 	root->setSectionDivisions(6);
 	root->setMinRadius(this->minRadius);
 	root->setMaxRadius(this->minRadius);
 	root->setSwelling(Vec2(1.5f, 1.5f));
 
-	updateBoundingBox(controls[0]);
-	updateBoundingBox(controls[1]);
-	return root;
+	updateBoundingBox(instance, controls[0]);
+	updateBoundingBox(instance, controls[1]);
+}
+
+/** Combine the changes that plants made on separate threads. */
+void Generator::updateInstances()
+{
+	for (Instance &instance : this->instances) {
+		this->width = std::max(this->width, instance.width);
+		this->rebuildVolume |= instance.outdated;
+		instance.outdated = false;
+	}
+}
+
+/** The volume is only rebuilt when a plant outgrows it or when stems are
+removed, moved or thinned. Otherwise only new path segments and segments that
+became thicker are added, since densities are never lowered, and the light
+from the previous iteration is cleared. Segments are collected for each plant
+in parallel. Lines and capsules only raise densities, so the segments are then
+added to the tree layout in parallel. The linear layout would serialize every
+addition, so its segments are added on one thread. */
+void Generator::updateVolume()
+{
+	auto collectSegments = [&](bool rebuild) {
+		parallelFor(this->instances.size(), [&](size_t i) {
+			Instance &instance = this->instances[i];
+			Stem *root = instance.plant->getRoot();
+			instance.segments.clear();
+			addToVolume(instance, root, rebuild);
+		});
+		updateInstances();
+	};
+
+	bool rebuild = this->rebuildVolume;
+	rebuild |= this->volume.getRoot()->getSize() != this->width;
+	if (!rebuild) {
+		collectSegments(false);
+		rebuild = this->rebuildVolume;
+	}
+	if (rebuild) {
+		int depth = std::log2(this->width) + this->depth;
+		if (depth <= 0)
+			depth = 1;
+		this->volume.clear(this->width*2.0f, depth);
+		this->rebuildVolume = false;
+		collectSegments(true);
+	} else
+		this->volume.clearFlux();
+
+	std::vector<const Segment *> segments;
+	for (const Instance &instance : this->instances)
+		for (const Segment &segment : instance.segments)
+			segments.push_back(&segment);
+	auto addSegment = [&](size_t i) {
+		const Segment *segment = segments[i];
+		if (this->voxelization == Capsules)
+			this->volume.addCapsule(segment->a, segment->b,
+				segment->startRadius, segment->radius, 1.0f);
+		else
+			this->volume.addLine(segment->a, segment->b, 1.0f,
+				segment->radius);
+	};
+	bool concurrent = this->threads > 1;
+	concurrent &= this->volume.getLayout() == Volume::Tree;
+	if (concurrent) {
+		this->volume.setConcurrent(true);
+		parallelFor(segments.size(), addSegment);
+		this->volume.setConcurrent(false);
+	} else
+		for (size_t i = 0; i < segments.size(); i++)
+			addSegment(i);
 }
 
-void Generator::addToVolume(Volume *volume, Stem *stem)
+void Generator::addToVolume(Instance &instance, Stem *stem, bool rebuild)
 {
 	const Path &path = stem->getPath();
 	Vec3 position = stem->getLocation();
-	for (size_t i = 1; i < path.getSize(); i++) {
-		Vec3 a = position + path.get(i-1);
-		Vec3 b = position + path.get(i);
-		float radius = this->plant->getRadius(stem, i);
-		volume->addLine(a, b, 1.0f, radius);
+	GeneratorState *state = stem->getState();
+	std::vector<float> &radii = state->radii;
+	size_t size = path.getSize();
+	size_t voxelized = rebuild ? 0 : state->voxelized;
+	if (voxelized > size || voxelized > radii.size())
+		instance.outdated = true;
+
+	/* Segments are added again if they became thicker. */
+	size_t start = std::max(voxelized, (size_t)1);
+	for (size_t i = 0; i < voxelized && !instance.outdated; i++) {
+		float radius = instance.plant->getRadius(stem, i);
+		if (radius < radii[i])
+			instance.outdated = true;
+		else if (radius > radii[i])
+			start = std::min(start, std::max(i, (size_t)1));
 	}
+	if (instance.outdated)
+		return;
+
+	radii.resize(size);
+	for (size_t i = 0; i < size; i++)
+		radii[i] = instance.plant->getRadius(stem, i);
+	for (size_t i = start; i < size; i++) {
+		Segment segment;
+		segment.a = position + path.get(i-1);
+		segment.b = position + path.get(i);
+		segment.startRadius = radii[i-1];
+		segment.radius = radii[i];
+		instance.segments.push_back(segment);
+	}
+	state->voxelized = size;
+
 	Stem *child = stem->getChild();
 	while (child) {
-		addToVolume(volume, child);
+		addToVolume(instance, child, rebuild);
 		child = child->getSibling();
 	}
 }
 
-void Generator::castRays(Volume *volume)
+/** Return the number of rays that were cast. */
+int Generator::castRays(Volume *volume)
+{
+	const int batches = (this->rays + raysPerBatch - 1) / raysPerBatch;
+	const int wave = this->threads > 1 ? 2 * this->threads : 1;
+	const unsigned seed = this->mt();
+	std::vector<std::vector<Flux>> fluxes(wave);
+	std::vector<std::vector<Volume::Node *>> shade(wave);
+	/* The light from even batches minus the light from odd batches. The
+	nodes are kept in the order they were first reached so that the sums
+	do not depend on the addresses of the nodes. */
+	std::unordered_map<Volume::Node *, size_t> slots;
+	std::vector<Volume::Node *> touched;
+	std::vector<Vec3> differences;
+	auto getDifference = [&](Volume::Node *node) -> Vec3 & {
+		auto slot = slots.emplace(node, touched.size());
+		if (slot.second) {
+			touched.push_back(node);
+			differences.push_back(Vec3(0.0f, 0.0f, 0.0f));
+		}
+		return differences[slot.first->second];
+	};
+	if (this->estimateVariance)
+		slots.reserve(this->rays);
+	createSamples();
+
+	std::vector<Volume::Node *> probes;
+	std::vector<Vec3> estimates;
+	int checkpoint = batches;
+	if (this->tolerance > 0.0f) {
+		for (Instance &instance : this->instances)
+			addProbes(volume, instance.plant->getRoot(), probes);
+		checkpoint = std::min(batches, firstCheckpoint);
+	}
+
+	/* Batches are traced in parallel but merged in order so that the sum
+	stored in each node is the same for any number of threads. Checkpoints
+	do not depend on the number of threads either. */
+	int first = 0;
+	while (first < batches) {
+		if (first == checkpoint) {
+			if (hasConverged(probes, estimates))
+				break;
+			checkpoint = std::min(batches, 2 * checkpoint);
+		}
+		int count = std::min(wave, checkpoint - first);
+		parallelFor(count, [&](size_t i) {
+			int batch = first + i;
+			int start = batch * raysPerBatch;
+			int end = std::min(this->rays, start + raysPerBatch);
+			std::seed_seq sequence{seed, (unsigned)batch};
+			std::mt19937 mt(sequence);
+			fluxes[i].clear();
+			shade[i].clear();
+			for (int j = start; j < end; j++)
+				updateRadiantEnergy(volume, createRay(mt, j),
+					fluxes[i], shade[i]);
+		});
+		for (int i = 0; i < count; i++) {
+			for (const Flux &flux : fluxes[i]) {
+				Volume::Node *node = flux.node;
+				node->setQuantity(node->getQuantity() + 1);
+				Vec3 direction = node->getDirection();
+				node->setDirection(direction + flux.direction);
+			}
+			for (Volume::Node *node : shade[i])
+				node->setQuantity(node->getQuantity() + 1);
+			if (!this->estimateVariance)
+				continue;
+			float sign = (first + i) % 2 == 0 ? 1.0f : -1.0f;
+			for (const Flux &flux : fluxes[i]) {
+				Vec3 &difference = getDifference(flux.node);
+				difference += sign * flux.direction;
+			}
+			for (Volume::Node *node : shade[i])
+				getDifference(node);
+		}
+		first += count;
+	}
+
+	/* The halves are independent estimates, so the variance of their sum
+	is about the squared length of their difference. */
+	float variance = 0.0f;
+	float total = 0.0f;
+	for (size_t i = 0; i < touched.size(); i++) {
+		Vec3 direction = touched[i]->getDirection();
+		variance += dot(differences[i], differences[i]);
+		total += dot(direction, direction);
+	}
+	this->fluxVariance = total > 0.0f ? variance / total : 0.0f;
+	return std::min(this->rays, first * raysPerBatch);
+}
+
+/* A grid of cells at one depth of the volume with the leaf or the divided
+node at that depth that contains each cell. */
+struct ShadowGrid {
+	int size;
+	float width;
+	Vec3 corner;
+	std::vector<float> densities;
+	std::vector<Volume::Node *> nodes;
+
+	size_t getIndex(int x, int y, int z) const
+	{
+		return ((size_t)z * this->size + y) * this->size + x;
+	}
+};
+
+/* Fill the cells of a node. A ray loses the density of each node that it
+passes through, so the density of a leaf is divided between its layers of
+cells. A divided node has the average density of the nodes below it, which
+a ray passes through several layers of. */
+void rasterize(ShadowGrid &grid, Volume::Node *node, int depth, int layers)
+{
+	if (node->getNode(0) && node->getDepth() < depth) {
+		for (int i = 0; i < 8; i++)
+			rasterize(grid, node->getNode(i), depth, layers);
+		return;
+	}
+
+	float size = node->getSize();
+	Vec3 start = node->getCenter() - Vec3(size) - grid.corner;
+	start /= grid.width;
+	int count = std::max((int)std::lround(2.0f * size / grid.width), 1);
+	int x0 = std::lround(start.x);
+	int y0 = std::lround(start.y);
+	int z0 = std::lround(start.z);
+	float density = node->getDensity() / count;
+	if (node->getNode(0))
+		density *= layers;
+	for (int z = z0; z < z0 + count; z++) {
+		for (int y = y0; y < y0 + count; y++) {
+			for (int x = x0; x < x0 + count; x++) {
+				size_t index = grid.getIndex(x, y, z);
+				grid.densities[index] = density;
+				grid.nodes[index] = node;
+			}
+		}
+	}
+}
+
+/* Give the leaves below a node the light of the node. */
+void setFlux(Volume::Node *node, Vec3 direction, int quantity)
+{
+	for (int i = 0; i < 8; i++) {
+		Volume::Node *child = node->getNode(i);
+		if (child->getNode(0))
+			setFlux(child, direction, quantity);
+		else {
+			child->setDirection(direction);
+			child->setQuantity(quantity);
+		}
+	}
+}
+
+/** Compute the light in the volume in one sweep from the top of the volume
+to the bottom instead of casting rays. Light reaches a cell from the nine
+cells above it and loses the density of the cells that it passes, so that
+each occupied cell casts a shadow in the shape of a pyramid below it. The
+light is stored in the same way as light from rays. */
+void Generator::propagateShadows(Volume *volume)
+{
+	Volume::Node *root = volume->getRoot();
+	ShadowGrid grid;
+	int depth = std::min(volume->getDepth(), maxShadowDepth);
+	grid.size = 1 << depth;
+	grid.width = 2.0f * root->getSize() / grid.size;
+	grid.corner = root->getCenter() - Vec3(root->getSize());
+	size_t cells = (size_t)grid.size * grid.size * grid.size;
+	grid.densities.resize(cells);
+	grid.nodes.resize(cells);
+	rasterize(grid, root, depth, 1 << (volume->getDepth() - depth));
+
+	Vec3 directions[9];
+	for (int i = 0; i < 9; i++) {
+		Vec3 d(1 - i % 3, 1 - i / 3, -1.0f);
+		directions[i] = normalize(d) / 9.0f;
+	}
+
+	/* Light leaving the cells of the layer above and of the current
+	layer. Light enters unobstructed at the top and the sides. */
+	const int n = grid.size;
+	std::vector<float> above(n * n, 1.0f);
+	std::vector<float> below(n * n);
+	for (int z = n - 1; z >= 0; z--) {
+		for (int y = 0; y < n; y++) {
+			for (int x = 0; x < n; x++) {
+				Vec3 direction(0.0f, 0.0f, 0.0f);
+				float light = 0.0f;
+				for (int i = 0; i < 9; i++) {
+					int sx = x + i % 3 - 1;
+					int sy = y + i / 3 - 1;
+					bool inside = sx >= 0 && sx < n;
+					inside &= sy >= 0 && sy < n;
+					float l = 1.0f;
+					if (inside)
+						l = above[sy * n + sx];
+					light += l;
+					direction += l * directions[i];
+				}
+				size_t index = grid.getIndex(x, y, z);
+				Volume::Node *node = grid.nodes[index];
+				direction += node->getDirection();
+				node->setDirection(direction);
+				node->setQuantity(node->getQuantity() + 1);
+				light = light / 9.0f - grid.densities[index];
+				below[y * n + x] = std::max(light, 0.0f);
+			}
+		}
+		above.swap(below);
+	}
+
+	for (size_t i = 0; i < cells; i++) {
+		Volume::Node *node = grid.nodes[i];
+		Vec3 direction = node->getDirection();
+		if (node->getNode(0))
+			setFlux(node, direction, node->getQuantity());
+	}
+	this->fluxVariance = 0.0f;
+}
+
+/** Add the nodes that evaluateEfficiency and getDirection read the light
+from. */
+void Generator::addProbes(Volume *volume, Stem *stem,
+	std::vector<Volume::Node *> &probes)
+{
+	const Path &path = stem->getPath();
+	Vec3 location = stem->getLocation();
+	Vec3 tip = location + path.get(path.getSize()-1);
+	probes.push_back(volume->getNode(tip));
+	for (size_t i = 0; i < stem->getLeafCount(); i++) {
+		float position = stem->getLeaf(i)->getPosition();
+		Vec3 point = location + path.getIntermediate(position);
+		probes.push_back(volume->getNode(point));
+	}
+	Stem *child = stem->getChild();
+	while (child) {
+		addProbes(volume, child, probes);
+		child = child->getSibling();
+	}
+}
+
+/** Return the light that a node would have after generalizeFlux without
+modifying the volume. */
+Vec3 estimateFlux(Volume::Node *node,
+	std::unordered_map<Volume::Node *, Vec3> &estimates)
+{
+	if (!node->getNode(0)) {
+		if (node->getQuantity() == 0)
+			return node->getDirection();
+		Vec3 f = node->getDirection() / node->getQuantity();
+		float m = magnitude(f);
+		return m > 1.0f ? f/m : f;
+	}
+
+	auto it = estimates.find(node);
+	if (it != estimates.end())
+		return it->second;
+	Vec3 direction(0.0f, 0.0f, 0.0f);
+	float count = 0.0f;
+	for (int i = 0; i < 8; i++) {
+		Vec3 estimate = estimateFlux(node->getNode(i), estimates);
+		if (!isZero(estimate)) {
+			count += 1.0f;
+			direction += estimate;
+		}
+	}
+	if (count > 0.0f)
+		direction /= count;
+	estimates[node] = direction;
+	return direction;
+}
+
+/** Compare the light at each probe with the estimates from the previous
+checkpoint and store the new estimates. Like getDirection, the light of the
+closest ancestor is used if a probe has no light. */
+bool Generator::hasConverged(const std::vector<Volume::Node *> &probes,
+	std::vector<Vec3> &estimates)
+{
+	bool first = estimates.empty();
+	estimates.resize(probes.size());
+	std::unordered_map<Volume::Node *, Vec3> nodes;
+	float change = 0.0f;
+	for (size_t i = 0; i < probes.size(); i++) {
+		Volume::Node *node = probes[i];
+		Vec3 estimate(0.0f, 0.0f, 0.0f);
+		while (node && isZero(estimate)) {
+			estimate = estimateFlux(node, nodes);
+			node = node->getParent();
+		}
+		Vec3 difference = estimate - estimates[i];
+		change += dot(difference, difference);
+		estimates[i] = estimate;
+	}
+	if (first || probes.empty())
+		return false;
+	return std::sqrt(change / probes.size()) < this->tolerance;
+}
+
+/** Prepare the random values that are shared by all rays of an iteration. */
+void Generator::createSamples()
+{
+	if (this->sampling == Stratified) {
+		int size = std::sqrt(this->rays);
+		for (std::vector<int> &strata : this->strata) {
+			strata.resize(size * size);
+			for (size_t i = 0; i < strata.size(); i++)
+				strata[i] = i;
+			std::shuffle(strata.begin(), strata.end(), this->mt);
+		}
+	} else if (this->sampling == Sobol) {
+		for (int i = 0; i < 4; i++)
+			this->scramble[i] = this->mt();
+	}
+}
+
+Ray Generator::createRay(std::mt19937 &mt, int index)
 {
 	float w = this->width - 0.0001f;
+	if (this->sampling != Random) {
+		float sample[4];
+		getSample(mt, index, sample);
+		Ray ray;
+		ray.origin.x = w * (2.0f * sample[0] - 1.0f);
+		ray.origin.y = w * (2.0f * sample[1] - 1.0f);
+		ray.origin.z = this->width * 1.5f;
+		ray.direction.x = 2.0f * sample[2] - 1.0f;
+		ray.direction.y = 2.0f * sample[3] - 1.0f;
+		ray.direction.z = -1.0f;
+		ray.direction = normalize(ray.direction);
+		return ray;
+	}
+
 	std::uniform_real_distribution<float> dis1(-w, w);
 	std::uniform_real_distribution<float> dis2(-1.0f, 1.0f);
-	for (int i = 1; i <= this->rays; i++) {
-		float x = dis1(this->mt);
-		float y = dis1(this->mt);
-		float z = this->width*1.5f;
-		Ray ray;
-		ray.origin = Vec3(x, y, z);
-		x = dis2(this->mt);
-		y = dis2(this->mt);
-		z = -1.0f;
-		ray.direction = normalize(Vec3(x, y, z));
-		updateRadiantEnergy(volume, ray);
+	float x = dis1(mt);
+	float y = dis1(mt);
+	float z = this->width*1.5f;
+	Ray ray;
+	ray.origin = Vec3(x, y, z);
+	x = dis2(mt);
+	y = dis2(mt);
+	z = -1.0f;
+	ray.direction = normalize(Vec3(x, y, z));
+	return ray;
+}
+
+/** Return a point in [0, 1)^4 for a ray. The first two coordinates are for
+the origin and the last two are for the direction. */
+void Generator::getSample(std::mt19937 &mt, int index, float sample[4])
+{
+	std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+	if (this->sampling == Sobol) {
+		for (int i = 0; i < 4; i++) {
+			uint32_t x = getSobolSample(index, i);
+			x ^= this->scramble[i];
+			sample[i] = (x >> 8) * (1.0f / 16777216.0f);
+		}
+	} else if ((size_t)index < this->strata[0].size()) {
+		int size = std::sqrt(this->strata[0].size());
+		for (int i = 0; i < 2; i++) {
+			int cell = this->strata[i][index];
+			sample[2*i] = (cell % size + dis(mt)) / size;
+			sample[2*i+1] = (cell / size + dis(mt)) / size;
+		}
+		/* Jittered values can round up to one. */
+		for (int i = 0; i < 4; i++)
+			sample[i] = std::min(sample[i], 0.99999994f);
+	} else {
+		for (int i = 0; i < 4; i++)
+			sample[i] = dis(mt);
 	}
 }
 
-void Generator::updateRadiantEnergy(Volume *volume, Ray ray)
+/** Follow a ray until its light is used up. The nodes behind that point do
+not receive light, but the ray still counts towards the average light of each
+node. These nodes are listed separately, which skips reading their density and
+storing a direction for them. */
+void Generator::updateRadiantEnergy(Volume *volume, Ray ray,
+	vector<Flux> &fluxes, vector<Volume::Node *> &shade)
 {
 	float magnitude = 1.0f;
-	Volume::Node *node = nullptr;
-	Volume::Node *nextNode = volume->getNode(ray.origin);
-	while (nextNode && node != nextNode) {
-		node = nextNode;
-		node->setQuantity(node->getQuantity() + 1);
-		Vec3 direction = magnitude * ray.direction;
-		node->setDirection(node->getDirection() + direction);
+	Volume::Traversal traversal(volume, ray);
+	Volume::Node *node = traversal.next();
+	while (node && magnitude > 0.0f) {
+		fluxes.push_back({node, magnitude * ray.direction});
 		magnitude -= node->getDensity();
-		if (magnitude < 0.0f)
-			magnitude = 0.0f;
-		nextNode = node->getAdjacentNode(ray);
+		node = traversal.next();
+	}
+	while (node) {
+		shade.push_back(node);
+		node = traversal.next();
 	}
 }
 
@@ -177,27 +833,21 @@ float Generator::setConcentration(Stem *stem)
 	return total;
 }
 
-void Generator::generalizeDensity(Volume::Node *node)
+void generalizeDensity(Volume::Node *node)
 {
 	float density = 0.0f;
-	for (int i = 0; i < 8; i++) {
-		Volume::Node *child = node->getNode(i);
-		if (child->getNode(0))
-			generalizeDensity(child);
-		density += child->getDensity();
-	}
+	for (int i = 0; i < 8; i++)
+		density += node->getNode(i)->getDensity();
 	node->setDensity(density / 8.0f);
 }
 
-void Generator::generalizeFlux(Volume::Node *node)
+void generalizeFlux(Volume::Node *node)
 {
 	Vec3 direction(0.0f, 0.0f, 0.0f);
 	float count = 0.0f;
 	for (int i = 0; i < 8; i++) {
 		Volume::Node *n = node->getNode(i);
-		if (n->getNode(0))
-			generalizeFlux(n);
-		else if (n->getQuantity() > 0) {
+		if (!n->getNode(0) && n->getQuantity() > 0) {
 			Vec3 f = n->getDirection() / n->getQuantity();
 			float m = magnitude(f);
 			if (m > 1.0f)
@@ -214,9 +864,113 @@ void Generator::generalizeFlux(Volume::Node *node)
 		node->setDirection(direction / count);
 }
 
-float Generator::evaluateEfficiency(Volume *volume, Stem *stem)
+void generalize(Volume::Node *node, void (*function)(Volume::Node *))
+{
+	for (int i = 0; i < 8; i++) {
+		Volume::Node *child = node->getNode(i);
+		if (child->getNode(0))
+			generalize(child, function);
+	}
+	function(node);
+}
+
+/** Apply a function to each divided node after its divided children. Each
+node is computed the same way as with a recursive traversal, so the result
+does not depend on the number of threads. The linear layout is processed
+level by level while the tree layout is split into subtrees below the top
+octants. */
+void Generator::generalize(Volume *volume,
+	void (*function)(Volume::Node *))
+{
+	if (!volume->getRoot()->getNode(0))
+		return;
+
+	std::vector<std::vector<Volume::Node *>> levels;
+	if (volume->getLayout() == Volume::Linear) {
+		for (int depth = 0; depth < volume->getDepth(); depth++)
+			levels.push_back(volume->getDividedNodes(depth));
+	} else {
+		levels.push_back({volume->getRoot()});
+		for (int depth = 1; depth <= splitDepth; depth++) {
+			levels.emplace_back();
+			for (Volume::Node *node : levels[depth-1]) {
+				for (int i = 0; i < 8; i++) {
+					Volume::Node *child = node->getNode(i);
+					if (child->getNode(0))
+						levels[depth].push_back(child);
+				}
+			}
+		}
+		std::vector<Volume::Node *> subtrees = levels.back();
+		levels.pop_back();
+		parallelFor(subtrees.size(), [&](size_t i) {
+			::generalize(subtrees[i], function);
+		});
+	}
+
+	for (auto level = levels.rbegin(); level != levels.rend(); level++) {
+		std::vector<Volume::Node *> &nodes = *level;
+		size_t size = nodes.size();
+		size_t chunks = (size + nodesPerChunk - 1) / nodesPerChunk;
+		parallelFor(chunks, [&](size_t i) {
+			size_t start = i * nodesPerChunk;
+			size_t end = std::min(size, start + nodesPerChunk);
+			for (size_t j = start; j < end; j++)
+				function(nodes[j]);
+		});
+	}
+}
+
+/** Evaluate the branches of every plant in parallel and then delete the
+stems that do not produce enough energy. */
+void Generator::removeInefficientStems()
+{
+	std::vector<std::pair<size_t, Stem *>> branches;
+	for (size_t i = 0; i < this->instances.size(); i++) {
+		Stem *child = this->instances[i].plant->getRoot()->getChild();
+		while (child) {
+			branches.push_back(std::make_pair(i, child));
+			child = child->getSibling();
+		}
+	}
+
+	std::vector<std::vector<Stem *>> inefficient(branches.size());
+	parallelFor(branches.size(), [&](size_t i) {
+		Stem *stem = branches[i].second;
+		evaluateEfficiency(&this->volume, stem, inefficient[i]);
+	});
+
+	std::vector<std::vector<Stem *>> stems(this->instances.size());
+	for (size_t i = 0; i < branches.size(); i++) {
+		std::vector<Stem *> &plantStems = stems[branches[i].first];
+		plantStems.insert(plantStems.end(), inefficient[i].begin(),
+			inefficient[i].end());
+	}
+	parallelFor(stems.size(), [&](size_t i) {
+		if (!stems[i].empty()) {
+			Plant *plant = this->instances[i].plant;
+			plant->deleteStems(stems[i]);
+			this->instances[i].outdated = true;
+			if (!this->compact)
+				return;
+			/* Move the remaining stems together once most of the
+			pools are empty. */
+			StemPool::Occupancy occupancy;
+			occupancy = plant->getStemPool()->getOccupancy();
+			if (2 * occupancy.allocated < occupancy.capacity)
+				plant->compact();
+		}
+	});
+}
+
+/** Return the energy that a stem and its descendants produce. Stems that
+produce too little for their size are added to the list, which only keeps
+the highest of inefficient stems that are descendants of each other. */
+float Generator::evaluateEfficiency(Volume *volume, Stem *stem,
+	std::vector<Stem *> &inefficient)
 {
 	float total = 0.0f;
+	size_t first = inefficient.size();
 
 	for (size_t i = 0; i < stem->getLeafCount(); i++) {
 		const Leaf *leaf = stem->getLeaf(i);
@@ -229,26 +983,27 @@ float Generator::evaluateEfficiency(Volume *volume, Stem *stem)
 
 	Stem *child = stem->getChild();
 	while (child) {
-		Stem *sibling = child->getSibling();
-		total += evaluateEfficiency(volume, child);
-		child = sibling;
+		total += evaluateEfficiency(volume, child, inefficient);
+		child = child->getSibling();
 	}
 
 	float r = stem->getMaxRadius();
 	float l = stem->getPath().getLength();
 	float p = total/(total + l*r);
-	if (stem->getParent() && p < this->synthesisThreshold)
-		this->plant->deleteStem(stem);
+	if (stem->getParent() && p < this->synthesisThreshold) {
+		inefficient.resize(first);
+		inefficient.push_back(stem);
+	}
 
 	return total;
 }
 
-void Generator::addNodes(Volume *volume, Stem *stem)
+void Generator::addNodes(Volume *volume, Instance &instance, Stem *stem)
 {
-	addNode(volume, stem);
+	addNode(volume, instance, stem);
 	Stem *child = stem->getChild();
 	while (child) {
-		addNodes(volume, child);
+		addNodes(volume, instance, child);
 		child = child->getSibling();
 	}
 }
@@ -278,11 +1033,11 @@ float getGrowthRate(Stem *stem, float radius)
 	return rate > 0.1f ? rate : 0.0f;
 }
 
-void Generator::addNode(Volume *volume, Stem *stem)
+void Generator::addNode(Volume *volume, Instance &instance, Stem *stem)
 {
 	float rate = 1.0f;
 	if (stem->getParent()) {
-		float radius = this->plant->getRadiusAt(stem);
+		float radius = instance.plant->getRadiusAt(stem);
 		rate = getGrowthRate(stem, radius);
 		if (rate == 0.0f)
 			return;
@@ -290,9 +1045,8 @@ void Generator::addNode(Volume *volume, Stem *stem)
 	} else
 		updateRadius(stem, std::numeric_limits<float>::max());
 
-	Path path = stem->getPath();
-	Spline spline = path.getSpline();
-	std::vector<Vec3> controls = spline.getControls();
+	const Path &path = stem->getPath();
+	const std::vector<Vec3> &controls = path.getSpline().getControls();
 
 	Ray ray;
 	ray.origin = controls.back();
@@ -300,22 +1054,34 @@ void Generator::addNode(Volume *volume, Stem *stem)
 	Vec3 direction = getDirection(stem, ray.origin, ray.direction, volume);
 	Vec3 point = ray.origin + rate * this->primaryGrowthRate * direction;
 
+	bool extend = true;
 	size_t size = controls.size();
 	if (size > 2 && this->optimization > 0.0f) {
 		Vec3 d1 = normalize(controls[size-1] - controls[size-2]);
 		Vec3 d2 = normalize(point - controls[size-1]);
-		if (dot(d1, d2) < 1.0f - 2.0*this->optimization)
-			controls.push_back(point);
-		else
-			controls[size-1] = point;
-	} else
-		controls.push_back(point);
+		extend = dot(d1, d2) < 1.0f - 2.0*this->optimization;
+	}
 
-	spline.setControls(controls);
-	path.setSpline(spline);
-	stem->setPath(path);
+	std::vector<Vec3> newControls;
+	newControls.reserve(size + 1);
+	newControls.assign(controls.begin(), controls.end());
+	if (extend)
+		newControls.push_back(point);
+	else {
+		newControls[size-1] = point;
+		if (stem->getState()->voxelized >= size)
+			instance.outdated = true;
+	}
+
+	/* The path and its controls are not valid after the path is set. */
+	Spline spline;
+	spline.setDegree(path.getSpline().getDegree());
+	spline.setControls(std::move(newControls));
+	Path newPath = path;
+	newPath.setSpline(std::move(spline));
+	stem->setPath(std::move(newPath));
 
-	updateBoundingBox(point + stem->getLocation());
+	updateBoundingBox(instance, point + stem->getLocation());
 	addLeaves(stem, stem->getState()->node++);
 }
 
@@ -325,18 +1091,18 @@ Vec3 getInitialDirection(Leaf leaf, Stem *stem, Volume *volume)
 	return getDirection(stem, Vec3(0.0f, 0.0f, 0.0f), d, volume);
 }
 
-void Generator::addStems(Stem *stem, Volume *volume)
+void Generator::addStems(Instance &instance, Stem *stem, Volume *volume)
 {
 	Stem *child = stem->getChild();
 	while (child) {
-		addStems(child, volume);
+		addStems(instance, child, volume);
 		child = child->getSibling();
 	}
 	if (stem->getMaxRadius() > stem->getMinRadius())
-		addStem(stem, volume);
+		addStem(instance, stem, volume);
 }
 
-void Generator::addStem(Stem *stem, Volume *volume)
+void Generator::addStem(Instance &instance, Stem *stem, Volume *volume)
 {
 	for (size_t i = 0; i < stem->getLeaves().size(); i++) {
 		Leaf leaf = *stem->getLeaf(i);
@@ -345,7 +1111,7 @@ void Generator::addStem(Stem *stem, Volume *volume)
 		Vec3 direction = getInitialDirection(leaf, stem, volume);
 		Vec3 point = (this->primaryGrowthRate/2.0f) * direction;
 
-		Stem *child = this->plant->addStem(stem);
+		Stem *child = instance.plant->addStem(stem);
 		child->setDistance(leaf.getPosition());
 		child->setSwelling(Vec2(1.5f, 3.0f));
 		Path path;
@@ -353,8 +1119,8 @@ void Generator::addStem(Stem *stem, Volume *volume)
 		spline.addControl(Vec3(0.0f, 0.0f, 0.0f));
 		spline.addControl(point);
 		spline.setDegree(1);
-		path.setSpline(spline);
-		child->setPath(path);
+		path.setSpline(std::move(spline));
+		child->setPath(std::move(path));
 		child->setMinRadius(this->minRadius);
 		child->setMaxRadius(this->minRadius);
 
@@ -362,7 +1128,7 @@ void Generator::addStem(Stem *stem, Volume *volume)
 		childLeaf.setPosition(this->primaryGrowthRate);
 		child->addLeaf(childLeaf);
 
-		updateBoundingBox(point + stem->getLocation());
+		updateBoundingBox(instance, point + stem->getLocation());
 	}
 }
 
@@ -392,23 +1158,58 @@ Leaf Generator::createLeaf()
 }
 
 /** A bounding box is created to determine how rays should be generated. */
-void Generator::updateBoundingBox(Vec3 point)
+void Generator::updateBoundingBox(Instance &instance, Vec3 point)
 {
 	point.x = std::abs(point.x) * 2.0f + 0.1f;
 	point.y = std::abs(point.y) * 2.0f + 0.1f;
 	point.z = std::abs(point.z) * 2.0f + 0.1f;
-	if (point.x > this->width)
-		this->width = point.x;
-	if (point.y > this->width)
-		this->width = point.y;
-	if (point.z > this->width)
-		this->width = point.z;
+	if (point.x > instance.width)
+		instance.width = point.x;
+	if (point.y > instance.width)
+		instance.width = point.y;
+	if (point.z > instance.width)
+		instance.width = point.z;
 }
 
 void Generator::clearVolume()
 {
 	this->width = 1.0f;
 	this->volume.clear(this->width, this->depth);
+	this->rebuildVolume = true;
+	this->cycle = 0;
+	this->iteration = 0;
+	this->prepared = false;
+	this->instances.clear();
+}
+
+void Generator::cancel()
+{
+	this->cancelled = true;
+}
+
+void Generator::resume()
+{
+	this->cancelled = false;
+}
+
+bool Generator::isCancelled() const
+{
+	return this->cancelled;
+}
+
+double Generator::getTime(Phase phase) const
+{
+	return this->times[phase];
+}
+
+const std::vector<int> &Generator::getRayCounts() const
+{
+	return this->rayCounts;
+}
+
+float Generator::getFluxVariance() const
+{
+	return this->fluxVariance;
 }
 
 const Volume *Generator::getVolume()
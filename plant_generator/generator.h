@@ -16,39 +16,224 @@
 #ifndef PG_GENERATOR_H
 #define PG_GENERATOR_H
 
+#include "parallel.h"
 #include "plant.h"
 #include "mesh/mesh.h"
 #include "volume.h"
 #include "math/intersection.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <map>
 #include <random>
 
+#ifdef PG_SERIALIZE
+#include <sstream>
+#include <boost/archive/archive_exception.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/vector.hpp>
+#endif
+
 namespace pg {
 	class Generator {
+	public:
+		/** Parts of an iteration that are timed. Growing new stems and
+		suppression are part of AddNodes, and propagating shadows is
+		part of CastRays. */
+		enum Phase {AddToVolume, CastRays, Generalize, AddNodes,
+			EvaluateEfficiency, Phases};
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		/* Light that a ray contributes to a node of the volume. */
+		struct Flux {
+			Volume::Node *node;
+			Vec3 direction;
+		};
+
+		/* A path segment of a stem that is added to the volume. */
+		struct Segment {
+			Vec3 a;
+			Vec3 b;
+			float startRadius;
+			float radius;
+		};
+
+		/* A plant of the stand with the state that is updated while it
+		grows, so that plants can be updated on separate threads. */
+		struct Instance {
+			Plant *plant;
+			float width;
+			/* Whether stems were removed or moved, which can only
+			be undone by rebuilding the volume. */
+			bool outdated;
+			std::vector<Segment> segments;
+		};
+
 		Plant *plant;
+		std::vector<Instance> instances;
 		float width;
 		Volume volume;
+		bool rebuildVolume;
+		int cycle;
+		/* The number of iterations of the current cycle that were
+		grown, and whether stems were pruned and added at its start. */
+		int iteration;
+		bool prepared;
 		std::mt19937 mt;
+		/* Shuffled origin and direction strata for stratified
+		sampling. */
+		std::vector<int> strata[2];
+		/* Random digital shift of the Sobol sequence in each
+		dimension. */
+		uint32_t scramble[4];
+		float fluxVariance;
+		std::vector<int> rayCounts;
+		double times[Phases];
+		std::atomic<bool> cancelled;
+		/* Threads that are kept between phases and cycles. */
+		std::unique_ptr<TaskPool> pool;
 
-		Stem *createRoot();
-		void addToVolume(Volume *, Stem *);
-		void castRays(Volume *);
-		void updateRadiantEnergy(Volume *, Ray);
+		void parallelFor(size_t, std::function<void(size_t)>);
+		void createRoot(Instance &, Vec3);
+		void updateVolume();
+		void addToVolume(Instance &, Stem *, bool);
+		void updateInstances();
+		int castRays(Volume *);
+		void propagateShadows(Volume *);
+		void addProbes(Volume *, Stem *, std::vector<Volume::Node *> &);
+		bool hasConverged(const std::vector<Volume::Node *> &,
+			std::vector<Vec3> &);
+		void createSamples();
+		Ray createRay(std::mt19937 &, int);
+		void getSample(std::mt19937 &, int, float [4]);
+		void updateRadiantEnergy(Volume *, Ray, std::vector<Flux> &,
+			std::vector<Volume::Node *> &);
 		float setConcentration(Stem *);
-		void generalizeDensity(Volume::Node *);
-		void generalizeFlux(Volume::Node *);
-		float evaluateEfficiency(Volume *, Stem *);
-		void addNodes(Volume *, Stem *);
-		void addNode(Volume *, Stem *);
+		void generalize(Volume *, void (*)(Volume::Node *));
+		void removeInefficientStems();
+		float evaluateEfficiency(Volume *, Stem *,
+			std::vector<Stem *> &);
+		void addNodes(Volume *, Instance &, Stem *);
+		void addNode(Volume *, Instance &, Stem *);
 		void updateRadius(Stem *, float);
-		void addStems(Stem *, Volume *);
-		void addStem(Stem *, Volume *);
+		void addStems(Instance &, Stem *, Volume *);
+		void addStem(Instance &, Stem *, Volume *);
 		void addLeaves(Stem *, int);
 		Leaf createLeaf();
-		void updateBoundingBox(Vec3);
+		void updateBoundingBox(Instance &, Vec3);
+		Clock::time_point addTime(Phase, Clock::time_point);
+		void getStates(const Stem *,
+			std::vector<GeneratorState> &) const;
+		void setStates(Stem *, const std::vector<GeneratorState> &,
+			size_t &);
+
+#ifdef PG_SERIALIZE
+		friend class boost::serialization::access;
+		template<class Archive>
+		void save(Archive &ar, const unsigned) const
+		{
+			std::ostringstream stream;
+			stream << mt;
+			std::string engine = stream.str();
+			size_t count = instances.size();
+			ar & engine;
+			ar & cycle;
+			ar & width;
+			ar & rebuildVolume;
+			ar & fluxVariance;
+			ar & rayCounts;
+			ar & count;
+			ar & iteration;
+			ar & prepared;
+			for (const Instance &instance : instances) {
+				std::vector<GeneratorState> states;
+				getStates(instance.plant->getRoot(), states);
+				ar & *instance.plant;
+				ar & instance.width;
+				ar & states;
+			}
+			ar & volume;
+		}
+		template<class Archive>
+		void load(Archive &ar, const unsigned)
+		{
+			/* Nothing is changed before the number of plants is
+			known to match. */
+			std::string engine;
+			int cycle;
+			float width;
+			bool rebuildVolume;
+			float fluxVariance;
+			std::vector<int> rayCounts;
+			size_t count;
+			int iteration;
+			bool prepared;
+			ar & engine;
+			ar & cycle;
+			ar & width;
+			ar & rebuildVolume;
+			ar & fluxVariance;
+			ar & rayCounts;
+			ar & count;
+			ar & iteration;
+			ar & prepared;
+			size_t plants = instances.size();
+			if (instances.empty() && plant)
+				plants = 1;
+			if (count != plants)
+				throw boost::archive::archive_exception(
+					boost::archive::archive_exception::
+					other_exception,
+					"the number of plants does not match");
+			if (instances.empty())
+				instances.push_back({plant, width, false, {}});
+			std::istringstream stream(engine);
+			stream >> this->mt;
+			this->cycle = cycle;
+			this->iteration = iteration;
+			this->prepared = prepared;
+			this->width = width;
+			this->rebuildVolume = rebuildVolume;
+			this->fluxVariance = fluxVariance;
+			this->rayCounts = rayCounts;
+			for (size_t i = 0; i < count; i++) {
+				std::vector<GeneratorState> states;
+				size_t index = 0;
+				Instance &instance = instances[i];
+				instance.plant->erase();
+				ar & *instance.plant;
+				ar & instance.width;
+				ar & states;
+				Stem *root = instance.plant->getRoot();
+				setStates(root, states, index);
+			}
+			ar & volume;
+			cancelled = false;
+		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER()
+#endif
 
 	public:
+		/** Random sampling places each ray independently. Stratified
+		sampling jitters rays on a grid over the sky square and a
+		shuffled grid of directions. Sobol sampling uses a randomly
+		shifted low-discrepancy sequence. */
+		enum Sampling {Random, Stratified, Sobol};
+		/** Stems are added to the volume either as lines that fill the
+		nodes they cross, or as capsules that add density in proportion
+		to how much of each node they cover. */
+		enum Voxelization {Lines, Capsules};
+		/** Light either comes from rays cast into the volume, or from
+		shadows that are propagated downwards through the volume in a
+		single sweep. Shadow propagation does not depend on the number
+		of rays or on the seed. */
+		enum LightModel {RayCasting, ShadowPropagation};
+
 		float primaryGrowthRate;
 		float secondaryGrowthRate;
 		float minRadius;
@@ -62,11 +247,81 @@ namespace pg {
 		int cycles;
 		int nodes;
 		int seed;
+		/** The number of threads used to cast rays and to update
+		plants. The result does not depend on the number of threads. The
+		threads are started once and reused until the number changes.
+		Stems are only added to the volume on several threads with the
+		tree layout. */
+		int threads;
+		/** The memory layout of the volume used for light
+		simulation. */
+		Volume::Layout layout;
+		/** How the origins and directions of rays are chosen. */
+		Sampling sampling;
+		Voxelization voxelization;
+		LightModel lightModel;
+		/** If positive, rays are cast until the light at leaves and
+		stem tips changes less than this when the number of rays is
+		doubled. The number of rays is then at most rays. */
+		float tolerance;
+		/** Move the stems of a plant into fewer pools once pruning
+		leaves most of the pools empty. This invalidates pointers to the
+		stems, so it should stay off while stems are referenced between
+		cycles. */
+		bool compact;
+		/** Estimate the variance of the light while rays are cast. This
+		costs a lookup for every node that a ray passes through. */
+		bool estimateVariance;
+		/** Called after each iteration with the number of completed
+		cycles and the number of nodes added in the current cycle. */
+		std::function<void(int, int)> progress;
 
 		Generator(Plant *plant);
 		void grow();
+		/** Grow several plants in one volume so that they compete for
+		light. The root of each plant starts at the given position, or
+		at the origin if there are fewer positions than plants. */
+		void grow(const std::vector<Plant *> &plants,
+			const std::vector<Vec3> &positions);
+		/** Remove the stems of the plant and create a new root without
+		growing any cycles. */
+		void start();
+		/** Start growing several plants in one volume. Plants without
+		a position start at the origin. Saving the generator after a
+		cycle stores the plants, so a checkpoint is loaded into the same
+		number of plants after calling start(). Loading it into a
+		different number of plants throws an archive_exception. */
+		void start(const std::vector<Plant *> &plants,
+			const std::vector<Vec3> &positions);
+		/** Grow the next cycle. Return false if every cycle was grown
+		or growth was cancelled. A cancelled cycle continues after
+		calling resume() from the start of the iteration that was
+		stopped, so the plants are the same as if growth had not been
+		cancelled. Growth can also continue after cycles is
+		increased. */
+		bool growCycle();
+		/** Return the number of cycles that were grown. */
+		int getCycle() const;
+		/** Clear the volume. Growth has to be started again. */
 		void clearVolume();
 		const Volume *getVolume();
+		/** Return the variance of the light in the volume relative to
+		the total light, estimated by comparing two halves of the last
+		rays cast. Smaller values mean that more rays would barely
+		change the growth directions. This is zero unless
+		estimateVariance is set. */
+		float getFluxVariance() const;
+		/** Return the number of rays that were cast in each cycle. */
+		const std::vector<int> &getRayCounts() const;
+		/** Stop growing after the current phase. This can be called
+		from another thread. */
+		void cancel();
+		/** Allow cycles to be grown after growth was cancelled. */
+		void resume();
+		bool isCancelled() const;
+		/** Return the seconds spent in a phase during the last
+		growth. */
+		double getTime(Phase phase) const;
 	};
 }
 
@@ -140,9 +140,10 @@ size_t Collar::insertCollar(
 	size_t offset = getTriangleOffset(parent, child);
 
 	Vec3 direction(0.0f);
-	int degree = path.getSpline().getDegree();
+	const Spline &spline = path.getSpline();
+	int degree = spline.getDegree();
 	if (degree == 3) {
-		auto controls = path.getSpline().getControls();
+		const std::vector<Vec3> &controls = spline.getControls();
 		direction = controls[3] - controls[2];
 	}
 
@@ -430,7 +430,7 @@ void MeshGenerator::addLeaf(Stem *stem, unsigned leafIndex, const State &state)
 
 Geometry MeshGenerator::transformLeaf(const Leaf *leaf, const Stem *stem)
 {
-	const Path path = stem->getPath();
+	const Path &path = stem->getPath();
 	Vec3 location = stem->getLocation();
 	float position = leaf->getPosition();
 
@@ -453,7 +453,7 @@ void MeshGenerator::setInitialJointState(State &state, const State &parentState)
 	state.jointID = 0;
 	state.jointIndex = 0;
 	state.jointOffset = 0.0f;
-	const vector<Joint> joints = stem->getJoints();
+	const vector<Joint> &joints = stem->getJoints();
 
 	if (joints.empty() && (!parent || !parent->hasJoints())) {
 		state.jointID = parentState.jointID;
@@ -471,7 +471,7 @@ void MeshGenerator::setInitialJointState(State &state, const State &parentState)
 pair<size_t, Joint> MeshGenerator::getJoint(float position, const Stem *stem)
 {
 	size_t index = stem->getPath().getIndex(position);
-	const vector<Joint> joints = stem->getJoints();
+	const vector<Joint> &joints = stem->getJoints();
 	size_t jointIndex = 0;
 	for (auto it = joints.begin(); it != joints.end(); it++) {
 		size_t pathIndex = it->getPathIndex();
@@ -504,7 +504,7 @@ void MeshGenerator::updateJointState(State &state, Vec2 &indices, Vec2 &weights)
 {
 	const Stem *stem = state.segment.stem;
 	const Path &path = stem->getPath();
-	const vector<Joint> joints = stem->getJoints();
+	const vector<Joint> &joints = stem->getJoints();
 	incrementJoint(state, joints);
 	size_t pathIndex = joints[state.jointIndex].getPathIndex();
 
@@ -536,7 +536,7 @@ void MeshGenerator::updateJointState(State &state, Vec2 &indices, Vec2 &weights)
 void MeshGenerator::setJointInfo(const Stem *stem, float jointOffset,
 	size_t jointIndex, Vec2 &weights, Vec2 &indices)
 {
-	const vector<Joint> joints = stem->getJoints();
+	const vector<Joint> &joints = stem->getJoints();
 	const Path &path = stem->getPath();
 	size_t pathIndex = joints[jointIndex].getPathIndex();
 	unsigned jointID = joints[jointIndex].getID();
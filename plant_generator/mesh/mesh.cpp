@@ -136,19 +136,33 @@ unsigned Mesh::getMaterialIndex(int mesh) const
 vector<DVertex> Mesh::getVertices() const
 {
 	vector<DVertex> object;
-	for (auto it = this->vertices.begin(); it != this->vertices.end(); it++)
-		object.insert(object.end(), it->begin(), it->end());
+	copyVertices(object);
 	return object;
 }
 
 vector<unsigned> Mesh::getIndices() const
 {
 	vector<unsigned> object;
-	for (auto it = this->indices.begin(); it != this->indices.end(); it++)
-		object.insert(object.end(), it->begin(), it->end());
+	copyIndices(object);
 	return object;
 }
 
+void Mesh::copyVertices(vector<DVertex> &buffer) const
+{
+	buffer.clear();
+	buffer.reserve(getVertexCount());
+	for (auto it = this->vertices.begin(); it != this->vertices.end(); it++)
+		buffer.insert(buffer.end(), it->begin(), it->end());
+}
+
+void Mesh::copyIndices(vector<unsigned> &buffer) const
+{
+	buffer.clear();
+	buffer.reserve(getIndexCount());
+	for (auto it = this->indices.begin(); it != this->indices.end(); it++)
+		buffer.insert(buffer.end(), it->begin(), it->end());
+}
+
 const vector<DVertex> *Mesh::getVertices(int mesh) const
 {
 	return &this->vertices.at(mesh);
@@ -57,6 +57,11 @@ namespace pg {
 
 		std::vector<DVertex> getVertices() const;
 		std::vector<unsigned> getIndices() const;
+		/** Copy the vertices of every mesh into a buffer. The memory of
+		the buffer is reused if it is large enough. */
+		void copyVertices(std::vector<DVertex> &buffer) const;
+		/** Copy the indices of every mesh into a buffer. */
+		void copyIndices(std::vector<unsigned> &buffer) const;
 		const std::vector<DVertex> *getVertices(int mesh) const;
 		const std::vector<unsigned> *getIndices(int mesh) const;
 		/** Find the location of a stem in the buffer. */
@@ -0,0 +1,185 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "parallel.h"
+#include <algorithm>
+
+using pg::TaskPool;
+
+/* The pool and queue of the current thread. */
+thread_local TaskPool *currentPool = nullptr;
+thread_local size_t currentQueue = 0;
+
+void pg::parallelFor(size_t count, int threads,
+	std::function<void(size_t)> function)
+{
+	if (threads > 0 && (size_t)threads > count)
+		threads = count;
+	if (threads <= 1) {
+		for (size_t i = 0; i < count; i++)
+			function(i);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	auto work = [&]() {
+		for (size_t i = next++; i < count; i = next++)
+			function(i);
+	};
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; i++)
+		workers.emplace_back(work);
+	work();
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+TaskPool::TaskPool(int threads) :
+	pending(0),
+	queued(0),
+	stopping(false)
+{
+	if (threads < 1)
+		threads = 1;
+	for (int i = 0; i < threads; i++)
+		this->queues.emplace_back(new Queue());
+	for (int i = 1; i < threads; i++)
+		this->workers.emplace_back(&TaskPool::work, this, i);
+}
+
+TaskPool::~TaskPool()
+{
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stopping = true;
+	}
+	this->condition.notify_all();
+	for (std::thread &worker : this->workers)
+		worker.join();
+}
+
+void TaskPool::spawn(std::function<void()> task)
+{
+	if (this->workers.empty()) {
+		task();
+		return;
+	}
+
+	size_t index = currentPool == this ? currentQueue : 0;
+	this->pending++;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->queued++;
+	}
+	{
+		Queue &queue = *this->queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back(std::move(task));
+	}
+	this->condition.notify_one();
+}
+
+void TaskPool::wait()
+{
+	TaskPool *pool = currentPool;
+	size_t queue = currentQueue;
+	currentPool = this;
+	currentQueue = 0;
+	while (this->pending > 0)
+		if (!run(0))
+			std::this_thread::yield();
+	currentPool = pool;
+	currentQueue = queue;
+}
+
+void TaskPool::parallelFor(size_t count,
+	std::function<void(size_t)> function)
+{
+	size_t tasks = std::min(count, this->queues.size());
+	std::atomic<size_t> next(0);
+	std::atomic<size_t> remaining(tasks > 1 ? tasks - 1 : 0);
+	auto work = [&]() {
+		for (size_t i = next++; i < count; i = next++)
+			function(i);
+	};
+	for (size_t i = 1; i < tasks; i++)
+		spawn([&]() {
+			work();
+			remaining--;
+		});
+	work();
+
+	/* Only the tasks of this call are waited for, since the caller can
+	be a task of the pool that is still counted as pending. A worker
+	keeps its own queue while it helps. */
+	TaskPool *pool = currentPool;
+	size_t queue = currentQueue;
+	size_t index = pool == this ? queue : 0;
+	currentPool = this;
+	currentQueue = index;
+	while (remaining > 0)
+		if (!run(index))
+			std::this_thread::yield();
+	currentPool = pool;
+	currentQueue = queue;
+}
+
+int TaskPool::getThreads() const
+{
+	return this->queues.size();
+}
+
+void TaskPool::work(size_t index)
+{
+	currentPool = this;
+	currentQueue = index;
+	while (true) {
+		if (run(index))
+			continue;
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->condition.wait(lock, [&]() {
+			return this->stopping || this->queued > 0;
+		});
+		if (this->stopping)
+			return;
+	}
+}
+
+/** Run a task of a queue or steal one from another queue. */
+bool TaskPool::run(size_t index)
+{
+	std::function<void()> task;
+	size_t count = this->queues.size();
+	for (size_t i = 0; i < count && !task; i++) {
+		Queue &queue = *this->queues[(index + i) % count];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+		if (i == 0) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		this->queued--;
+	}
+	if (!task)
+		return false;
+	task();
+	this->pending--;
+	return true;
+}
@@ -0,0 +1,80 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PG_PARALLEL_H
+#define PG_PARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pg {
+	/** Call a function for each index in [0, count) using up to the given
+	number of threads. Indices are handed out dynamically, so the function
+	must not depend on which thread or in what order it is called. */
+	void parallelFor(size_t count, int threads,
+		std::function<void(size_t)> function);
+
+	/** Runs tasks that can add more tasks. Each thread runs the newest
+	task of its own queue and steals the oldest task of another queue when
+	its queue is empty, so that related tasks tend to stay on one thread.
+	Without additional threads, tasks are run as soon as they are added. */
+	class TaskPool {
+		struct Queue {
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		/* The first queue belongs to the thread that waits for the
+		tasks. */
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+		std::atomic<size_t> pending;
+		std::atomic<size_t> queued;
+		bool stopping;
+		std::mutex mutex;
+		std::condition_variable condition;
+
+		void work(size_t index);
+		bool run(size_t index);
+
+	public:
+		TaskPool(int threads);
+		TaskPool(const TaskPool &) = delete;
+		TaskPool &operator=(const TaskPool &) = delete;
+		~TaskPool();
+		void spawn(std::function<void()> task);
+		/** Help to run tasks until every task has finished. A task
+		must not wait for the pool, since it is counted as pending
+		itself. */
+		void wait();
+		/** Call a function for each index in [0, count) on the threads
+		of the pool and wait for every call to finish. Unlike the free
+		function, no threads are started. Only the calls of this loop
+		are waited for, so tasks of the pool can call it as well. */
+		void parallelFor(size_t count,
+			std::function<void(size_t)> function);
+		/** Return the number of threads including the waiting one. */
+		int getThreads() const;
+	};
+}
+
+#endif
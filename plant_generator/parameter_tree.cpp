@@ -23,7 +23,19 @@ using namespace pg;
 const float pi = 3.14159265359f;
 
 
-GeneratorState::GeneratorState() : suppression(0.0f), node(0)
+GeneratorState::GeneratorState() :
+	suppression(0.0f),
+	node(0),
+	voxelized(0)
+{
+
+}
+
+PatternState::PatternState() :
+	node(0),
+	stream(0),
+	length(0.0f),
+	totalLength(0.0f)
 {
 
 }
@@ -49,7 +61,18 @@ StemData::StemData() :
 	maxDepth(4),
 	seed(0)
 {
+	compileCurves();
+}
 
+void StemData::compileCurves()
+{
+	if (!this->densityCurve.isCompiled())
+		this->densityCurve.compile();
+	if (!this->inclineCurve.isCompiled())
+		this->inclineCurve.compile();
+	if (!this->lengthCurve.isCompiled())
+		this->lengthCurve.compile();
+	this->leaf.compileCurves();
 }
 
 LeafData::LeafData() :
@@ -67,7 +90,13 @@ LeafData::LeafData() :
 	gravity(0.0f),
 	leavesPerNode(1)
 {
+	compileCurves();
+}
 
+void LeafData::compileCurves()
+{
+	if (!this->densityCurve.isCompiled())
+		this->densityCurve.compile();
 }
 
 ParameterNode::ParameterNode() :
@@ -75,12 +104,19 @@ ParameterNode::ParameterNode() :
 	parent(nullptr),
 	nextSibling(nullptr),
 	prevSibling(nullptr),
-	data()
+	data(),
+	dirty(true)
 {
 
 }
 
-StemData ParameterNode::getData() const
+ParameterNode::~ParameterNode()
+{
+	delete this->child;
+	delete this->nextSibling;
+}
+
+const StemData &ParameterNode::getData() const
 {
 	return this->data;
 }
@@ -88,6 +124,13 @@ StemData ParameterNode::getData() const
 void ParameterNode::setData(StemData data)
 {
 	this->data = data;
+	this->data.compileCurves();
+	this->dirty = true;
+}
+
+bool ParameterNode::isDirty() const
+{
+	return this->dirty;
 }
 
 const ParameterNode *ParameterNode::getChild() const
@@ -115,42 +158,20 @@ const ParameterNode *ParameterNode::getParent() const
 	return this->parent;
 }
 
-ParameterTree::ParameterTree() : root(nullptr)
+ParameterTree::ParameterTree()
 {
 
 }
 
-ParameterTree::ParameterTree(const ParameterTree &original) : root(nullptr)
+/** Give this copy its own nodes if they are shared. */
+void ParameterTree::detach()
 {
-	copy(original);
-}
-
-ParameterTree::~ParameterTree()
-{
-	if (this->root) {
-		removeChildNode(this->root->child);
-		delete this->root;
-	}
-}
-
-void ParameterTree::removeChildNode(ParameterNode *node)
-{
-	if (node) {
-		removeChildNode(node->nextSibling);
-		removeChildNode(node->child);
-		delete node;
-	}
-}
-
-ParameterTree &ParameterTree::operator=(const ParameterTree &tree)
-{
-	reset();
-	copy(tree);
-	return *this;
+	if (this->root && this->root.use_count() > 1)
+		this->root.reset(copy(this->root.get()));
 }
 
 void ParameterTree::copyNode(const ParameterNode *originalNode,
-	ParameterNode *node)
+	ParameterNode *node) const
 {
 	if (!originalNode)
 		return;
@@ -158,6 +179,7 @@ void ParameterTree::copyNode(const ParameterNode *originalNode,
 		node->child = new ParameterNode();
 		node->child->parent = node;
 		node->child->data = originalNode->child->data;
+		node->child->dirty = originalNode->child->dirty;
 		copyNode(originalNode->child, node->child);
 	}
 	if (originalNode->nextSibling) {
@@ -165,55 +187,74 @@ void ParameterTree::copyNode(const ParameterNode *originalNode,
 		node->nextSibling->parent = node->parent;
 		node->nextSibling->prevSibling = node;
 		node->nextSibling->data = originalNode->nextSibling->data;
+		node->nextSibling->dirty = originalNode->nextSibling->dirty;
 		copyNode(originalNode->nextSibling, node->nextSibling);
 	}
 }
 
-void ParameterTree::copy(const ParameterTree &tree)
+ParameterNode *ParameterTree::copy(const ParameterNode *originalRoot) const
 {
-	if (tree.root) {
-		this->root = new ParameterNode();
-		this->root->data = tree.root->data;
-		if (tree.root->child) {
-			this->root->child = new ParameterNode();
-			this->root->child->data = tree.root->child->data;
-			copyNode(tree.root->child, this->root->child);
-		}
-	} else
-		this->root = nullptr;
+	ParameterNode *root = new ParameterNode();
+	root->data = originalRoot->data;
+	root->dirty = originalRoot->dirty;
+	if (originalRoot->child) {
+		root->child = new ParameterNode();
+		root->child->parent = root;
+		root->child->data = originalRoot->child->data;
+		root->child->dirty = originalRoot->child->dirty;
+		copyNode(originalRoot->child, root->child);
+	}
+	return root;
 }
 
 void ParameterTree::reset()
 {
-	if (this->root) {
-		removeChildNode(this->root->child);
-		delete this->root;
-		this->root = nullptr;
-	}
+	this->root.reset();
 }
 
-ParameterNode *ParameterTree::getRoot() const
+const ParameterNode *ParameterTree::getRoot() const
 {
-	return this->root;
+	return this->root.get();
+}
+
+ParameterNode *ParameterTree::getRoot()
+{
+	detach();
+	return this->root.get();
 }
 
 ParameterNode *ParameterTree::createRoot()
 {
-	reset();
-	this->root = new ParameterNode();
-	return this->root;
+	this->root.reset(new ParameterNode());
+	return this->root.get();
 }
 
-ParameterNode *ParameterTree::getNode() const
+const ParameterNode *ParameterTree::getNode() const
 {
 	return this->root ? this->root->child : nullptr;
 }
 
+ParameterNode *ParameterTree::getNode()
+{
+	detach();
+	return this->root ? this->root->child : nullptr;
+}
+
+bool ParameterTree::isShared() const
+{
+	return this->root && this->root.use_count() > 1;
+}
+
+/* Adding or removing nodes changes the positions that stems refer to, so
+the root is marked as dirty to grow every stem again. */
+
 ParameterNode *ParameterTree::addChild(string name)
 {
 	if (!this->root)
 		return nullptr;
-	else if (name.empty()) {
+	detach();
+	this->root->dirty = true;
+	if (name.empty()) {
 		ParameterNode *child = this->root->child;
 		this->root->child = new ParameterNode();
 		this->root->child->data.densityCurve.setDefault(1);
@@ -244,6 +285,9 @@ ParameterNode *ParameterTree::addSibling(string name)
 	ParameterNode *node = getNode(name, 0, this->root->child);
 	if (!node)
 		return nullptr;
+	detach();
+	node = getNode(name, 0, this->root->child);
+	this->root->dirty = true;
 	ParameterNode *sibling = node->nextSibling;
 	node->nextSibling = new ParameterNode();
 	node->nextSibling->data.densityCurve.setDefault(1);
@@ -254,7 +298,7 @@ ParameterNode *ParameterTree::addSibling(string name)
 	return node->nextSibling;
 }
 
-ParameterNode *ParameterTree::get(string name) const
+const ParameterNode *ParameterTree::get(string name) const
 {
 	if (name.empty() || !this->root)
 		return nullptr;
@@ -264,6 +308,18 @@ ParameterNode *ParameterTree::get(string name) const
 		return getNode(name, 0, this->root->child);
 }
 
+ParameterNode *ParameterTree::get(string name)
+{
+	const ParameterTree *tree = this;
+	if (!tree->get(name))
+		return nullptr;
+	detach();
+	if (name == "root")
+		return this->root.get();
+	else
+		return getNode(name, 0, this->root->child);
+}
+
 bool ParameterTree::remove(string name)
 {
 	if (!this->root)
@@ -273,9 +329,11 @@ bool ParameterTree::remove(string name)
 		return true;
 	}
 
-	ParameterNode *node = getNode(name, 0, this->root->child);
-	if (!node)
+	if (!getNode(name, 0, this->root->child))
 		return false;
+	detach();
+	ParameterNode *node = getNode(name, 0, this->root->child);
+	this->root->dirty = true;
 
 	if (node == this->root->child)
 		this->root->child = node->nextSibling;
@@ -286,7 +344,7 @@ bool ParameterTree::remove(string name)
 	if (node->parent && node->parent->child == node)
 		node->parent->child = node->nextSibling;
 
-	removeChildNode(node->child);
+	node->nextSibling = nullptr;
 	delete node;
 	return true;
 }
@@ -344,20 +402,53 @@ void ParameterTree::updateField(std::function<void(StemData *)> function,
 	std::string name)
 {
 	ParameterNode *node = get(name);
+	if (!node)
+		return;
 	function(&node->data);
+	node->data.compileCurves();
+	node->dirty = true;
 }
 
 void ParameterTree::updateFields(std::function<void(StemData *)> function)
 {
-	updateFields(function, this->root);
+	detach();
+	if (this->root)
+		updateFields(function, this->root.get());
 }
 
 void ParameterTree::updateFields(std::function<void(StemData *)> function,
 	ParameterNode *node)
 {
 	function(&node->data);
+	node->data.compileCurves();
+	node->dirty = true;
 	if (node->nextSibling)
 		updateFields(function, node->nextSibling);
 	if (node->child)
 		updateFields(function, node->child);
 }
+
+void ParameterTree::clean()
+{
+	if (this->root && isDirty(this->root.get())) {
+		detach();
+		clean(this->root.get());
+	}
+}
+
+bool ParameterTree::isDirty(const ParameterNode *node) const
+{
+	for (; node; node = node->nextSibling)
+		if (node->dirty || isDirty(node->child))
+			return true;
+	return false;
+}
+
+void ParameterTree::clean(ParameterNode *node)
+{
+	node->dirty = false;
+	if (node->nextSibling)
+		clean(node->nextSibling);
+	if (node->child)
+		clean(node->child);
+}
@@ -17,20 +17,56 @@
 #define PG_PARAMETER_TREE_H
 
 #include "spline.h"
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
 
 #ifdef PG_SERIALIZE
 #include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/shared_ptr.hpp>
+#include <boost/serialization/vector.hpp>
 #endif
 
 namespace pg {
 	struct GeneratorState {
 		float suppression;
 		int node;
+		/* The number of path points that were added to the volume. */
+		size_t voxelized;
+		/* The radii of the path points when they were added. */
+		std::vector<float> radii;
 
 		GeneratorState();
+
+#ifdef PG_SERIALIZE
+		template<class Archive>
+		void serialize(Archive &ar, const unsigned)
+		{
+			ar & suppression;
+			ar & node;
+			ar & voxelized;
+			ar & radii;
+		}
+#endif
+	};
+
+	/** How the pattern generator added a stem, which is needed to add
+	the stems of some parameter nodes again without changing the others. */
+	struct PatternState {
+		/* The position of the parameter node in a depth-first traversal
+		that starts at the root with one. Zero if the stem was not added
+		by the pattern generator. */
+		int node;
+		uint64_t stream;
+		/* The length of the ancestors and the length of the stem with
+		its longest fork, which lateral stems and leaves are placed
+		on. */
+		float length;
+		float totalLength;
+
+		PatternState();
 	};
 
 	struct LeafData {
@@ -49,6 +85,8 @@ namespace pg {
 		int leavesPerNode;
 
 		LeafData();
+		/** Compile curves that changed for faster lookups. */
+		void compileCurves();
 
 	private:
 #ifdef PG_SERIALIZE
@@ -69,6 +107,8 @@ namespace pg {
 			ar & gravity;
 			ar & leavesPerNode;
 			ar & scale;
+			if (Archive::is_loading::value)
+				compileCurves();
 		}
 #endif
 	};
@@ -96,6 +136,8 @@ namespace pg {
 		LeafData leaf;
 
 		StemData();
+		/** Compile curves that changed for faster lookups. */
+		void compileCurves();
 
 	private:
 #ifdef PG_SERIALIZE
@@ -127,6 +169,8 @@ namespace pg {
 			ar & noise;
 			ar & seed;
 			ar & leaf;
+			if (Archive::is_loading::value)
+				compileCurves();
 		}
 #endif
 	};
@@ -139,6 +183,7 @@ namespace pg {
 		ParameterNode *nextSibling;
 		ParameterNode *prevSibling;
 		StemData data;
+		bool dirty;
 
 		ParameterNode();
 		ParameterNode(const ParameterNode &) = delete;
@@ -157,8 +202,13 @@ namespace pg {
 		}
 #endif
 	public:
-		StemData getData() const;
+		/** A node owns its children and the siblings after it. */
+		~ParameterNode();
+		const StemData &getData() const;
 		void setData(StemData data);
+		/** Return true if the data changed since the tree was last
+		cleaned. New nodes are dirty. */
+		bool isDirty() const;
 		const ParameterNode *getChild() const;
 		const ParameterNode *getSibling() const;
 		const ParameterNode *getNextSibling() const;
@@ -166,12 +216,15 @@ namespace pg {
 		const ParameterNode *getParent() const;
 	};
 
+	/** Copies of a tree share their nodes until one of the copies is
+	changed. The nodes returned by the non-const methods belong to this
+	copy only and should not be kept after the tree is copied. */
 	class ParameterTree {
-		ParameterNode *root;
+		std::shared_ptr<ParameterNode> root;
 
-		void copy(const ParameterTree &);
-		void removeChildNode(ParameterNode *);
-		void copyNode(const ParameterNode *, ParameterNode *);
+		void detach();
+		ParameterNode *copy(const ParameterNode *) const;
+		void copyNode(const ParameterNode *, ParameterNode *) const;
 		int getSize(const std::string &, size_t &) const;
 		void getNames(std::vector<std::string> &, std::string,
 			ParameterNode *) const;
@@ -179,38 +232,58 @@ namespace pg {
 			ParameterNode *) const;
 		void updateFields(std::function<void(StemData *)>,
 			ParameterNode *);
+		bool isDirty(const ParameterNode *) const;
+		void clean(ParameterNode *);
 
 #ifdef PG_SERIALIZE
 		friend class boost::serialization::access;
 		template<class Archive>
-		void serialize(Archive &ar, const unsigned)
+		void save(Archive &ar, const unsigned) const
 		{
 			ar & root;
 		}
+		template<class Archive>
+		void load(Archive &ar, const unsigned version)
+		{
+			if (version >= 1)
+				ar & root;
+			else {
+				ParameterNode *node;
+				ar & node;
+				root.reset(node);
+			}
+		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER()
 #endif
 
 	public:
 		ParameterTree();
-		~ParameterTree();
-		ParameterTree(const ParameterTree &original);
-		ParameterTree &operator=(const ParameterTree &derivation);
 		void reset();
-		ParameterNode *getRoot() const;
+		const ParameterNode *getRoot() const;
+		ParameterNode *getRoot();
 		ParameterNode *createRoot();
-		ParameterNode *getNode() const;
+		const ParameterNode *getNode() const;
+		ParameterNode *getNode();
 		ParameterNode *addChild(std::string name);
 		ParameterNode *addSibling(std::string name);
-		ParameterNode *get(std::string name) const;
+		const ParameterNode *get(std::string name) const;
+		ParameterNode *get(std::string name);
 		bool remove(std::string name);
 		std::vector<std::string> getNames() const;
+		/** Return true if the nodes are shared with another copy. */
+		bool isShared() const;
 		void updateFields(std::function<void(StemData *)> function);
+		/** Change the data of a node and mark it as dirty. */
 		void updateField(std::function<void(StemData *)> function,
 			std::string name);
+		/** Mark every node as unchanged. */
+		void clean();
 	};
 }
 
 #ifdef PG_SERIALIZE
 BOOST_CLASS_VERSION(pg::StemData, 3)
+BOOST_CLASS_VERSION(pg::ParameterTree, 1)
 #endif
 
 #endif
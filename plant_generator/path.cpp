@@ -15,6 +15,7 @@
 
 #include "path.h"
 #include <limits>
+#include <utility>
 
 using pg::Path;
 using pg::Spline;
@@ -81,7 +82,12 @@ void Path::setSpline(const Spline &spline)
 	this->spline = spline;
 }
 
-Spline Path::getSpline() const
+void Path::setSpline(Spline &&spline)
+{
+	this->spline = std::move(spline);
+}
+
+const Spline &Path::getSpline() const
 {
 	return this->spline;
 }
@@ -117,7 +123,7 @@ int Path::getSubdivisions() const
 	return this->subdivisions;
 }
 
-std::vector<Vec3> Path::get() const
+const std::vector<Vec3> &Path::get() const
 {
 	return this->path;
 }
@@ -53,7 +53,8 @@ namespace pg {
 		Path();
 
 		void setSpline(const Spline &spline);
-		Spline getSpline() const;
+		void setSpline(Spline &&spline);
+		const Spline &getSpline() const;
 		/** Set the divisions for each curve in the path. */
 		void setDivisions(int divisions);
 		int getDivisions() const;
@@ -64,7 +65,7 @@ namespace pg {
 		/** Evaluate points along the spline. */
 		void generate();
 
-		std::vector<Vec3> get() const;
+		const std::vector<Vec3> &get() const;
 		/** Return a point on the path. */
 		Vec3 get(const int index) const;
 		/** Return the number of point on the path. */
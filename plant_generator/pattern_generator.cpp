@@ -15,14 +15,22 @@
 
 #include "plant.h"
 #include "pattern_generator.h"
+#include <algorithm>
 #include <cstdlib>
 #include <cmath>
+#include <utility>
 
 using namespace pg;
 
 const float pi = 3.14159265359f;
 
-PatternGenerator::PatternGenerator(Plant *plant) : plant(plant)
+PatternGenerator::PatternGenerator(Plant *plant) :
+	plant(plant),
+	maxDepth(0),
+	seed(0),
+	threads(1),
+	pool(nullptr),
+	mutex(nullptr)
 {
 
 }
@@ -39,13 +47,23 @@ void PatternGenerator::setParameterTree(ParameterTree parameterTree)
 
 void PatternGenerator::reset()
 {
-	ParameterNode *root = this->parameterTree.getRoot();
+	const ParameterNode *root = getParameterRoot();
 	if (root) {
 		this->maxDepth = root->getData().maxDepth;
-		this->mt.seed(root->getData().seed);
+		this->seed = root->getData().seed;
 	}
 }
 
+void PatternGenerator::setThreads(int threads)
+{
+	this->threads = threads;
+}
+
+int PatternGenerator::getThreads() const
+{
+	return this->threads;
+}
+
 void PatternGenerator::grow()
 {
 	Stem *stem = this->plant->createRoot();
@@ -54,28 +72,181 @@ void PatternGenerator::grow()
 	stem->setMaxRadius(0.2f);
 	stem->setMinRadius(0.01f);
 	stem->setSwelling(Vec2(1.3f, 1.3f));
-	const ParameterNode *root = this->parameterTree.getRoot();
-	if (root) {
-		reset();
-		Vec3 d(0.0f, 0.0f, 1.0f);
-		float l = getCollarLength(stem, d);
-		float ratio = setPath(stem, 0.0f, d, l, root->getData());
-		addStems(stem, ratio, 0.0f, root);
-	}
+	if (getParameterRoot())
+		growStem(stem, Vec3(0.0f, 0.0f, 1.0f));
 }
 
 void PatternGenerator::grow(Stem *stem)
 {
 	this->parameterTree = stem->getParameterTree();
-	ParameterNode *root = this->parameterTree.getRoot();
-	if (root) {
-		reset();
-		const Path &path = stem->getPath();
-		Vec3 d = path.getDirection(0);
-		float l = getCollarLength(stem, d);
-		float ratio = setPath(stem, 0.0f, d, l, root->getData());
-		addStems(stem, ratio, 0.0f, root);
+	if (getParameterRoot())
+		growStem(stem, stem->getPath().getDirection(0));
+}
+
+bool PatternGenerator::update(Stem *stem)
+{
+	const ParameterTree &tree = stem->getParameterTree();
+	const ParameterNode *root = tree.getRoot();
+	if (!root || root->isDirty() || stem->getPatternState()->node != 1)
+		return false;
+
+	this->parameterTree = tree;
+	this->nodes.clear();
+	this->indices.clear();
+	indexNodes(root);
+	if (!isGenerated(stem, root))
+		return false;
+
+	TaskPool pool(this->threads);
+	std::mutex mutex;
+	this->pool = &pool;
+	this->mutex = &mutex;
+	reset();
+	updateStems(stem);
+	pool.wait();
+	this->pool = nullptr;
+	this->mutex = nullptr;
+	this->parameterTree.clean();
+	stem->setParameterTree(this->parameterTree);
+	return true;
+}
+
+/** Return the root of the parameter tree without copying the nodes that
+are shared with stems. */
+const ParameterNode *PatternGenerator::getParameterRoot() const
+{
+	return this->parameterTree.getRoot();
+}
+
+/** Number the parameter nodes in depth-first order starting with one. */
+void PatternGenerator::indexNodes(const ParameterNode *node)
+{
+	while (node) {
+		this->nodes.push_back(node);
+		this->indices[node] = this->nodes.size();
+		indexNodes(node->getChild());
+		node = node->getSibling();
+	}
+}
+
+/** Return true if every stem that is not custom was added with a child of
+the parameter node of its parent or is a fork of its parent. */
+bool PatternGenerator::isGenerated(const Stem *stem,
+	const ParameterNode *node) const
+{
+	const Stem *child = stem->getChild();
+	while (child) {
+		int index = child->getPatternState()->node;
+		if (!child->isCustom()) {
+			if (index < 1 || index > (int)this->nodes.size())
+				return false;
+			const ParameterNode *childNode = this->nodes[index-1];
+			if (childNode != node && childNode->getParent() != node)
+				return false;
+			if (!isGenerated(child, childNode))
+				return false;
+		}
+		child = child->getSibling();
 	}
+	return true;
+}
+
+/** Replace the lateral stems of dirty parameter nodes. Kept stems are
+moved so that the children are in the same order as if every stem had been
+added again. */
+void PatternGenerator::updateStems(Stem *stem)
+{
+	const PatternState *state = stem->getPatternState();
+	const ParameterNode *node = this->nodes[state->node-1];
+	bool dirty = false;
+	const ParameterNode *childNode = node->getChild();
+	for (; childNode; childNode = childNode->getSibling())
+		dirty |= childNode->isDirty();
+
+	std::vector<Stem *> children;
+	std::vector<Stem *> removals;
+	Stem *child = stem->getChild();
+	for (; child; child = child->getSibling()) {
+		if (child->isCustom())
+			continue;
+		int index = child->getPatternState()->node;
+		if (this->nodes[index-1]->isDirty())
+			removals.push_back(child);
+		else
+			children.push_back(child);
+	}
+	std::reverse(children.begin(), children.end());
+	if (!dirty) {
+		for (Stem *child : children)
+			this->pool->spawn([this, child]() {
+				updateStems(child);
+			});
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(*this->mutex);
+		this->plant->deleteStems(removals);
+	}
+	for (int i = stem->getLeafCount() - 1; i >= 0; i--)
+		if (!stem->getLeaf(i)->isCustom())
+			stem->removeLeaf(i);
+
+	auto keep = [&](int index) {
+		for (Stem *child : children) {
+			if (child->getPatternState()->node != index)
+				continue;
+			this->plant->moveToFront(child);
+			this->pool->spawn([this, child]() {
+				updateStems(child);
+			});
+		}
+	};
+	keep(state->node);
+	childNode = node->getChild();
+	Length l(state->length, state->totalLength);
+	for (int i = 1; childNode; i++) {
+		if (childNode->isDirty()) {
+			uint64_t stream = state->stream;
+			stream = Philox::getStream(stream, i, 0);
+			addLateralStems(stem, l, childNode, stream);
+		} else
+			keep(this->indices.at(childNode));
+		addLeaves(stem, l, childNode->getData().leaf);
+		childNode = childNode->getSibling();
+	}
+}
+
+/** Replace the path of a stem and add stems to it. Each stem is grown by a
+task after it is added to its parent, so only the stems that share a parent
+are added in order. */
+void PatternGenerator::growStem(Stem *stem, Vec3 direction)
+{
+	const ParameterNode *root = getParameterRoot();
+	this->nodes.clear();
+	this->indices.clear();
+	indexNodes(root);
+	TaskPool pool(this->threads);
+	std::mutex mutex;
+	this->pool = &pool;
+	this->mutex = &mutex;
+	reset();
+	Philox random(this->seed);
+	float l = getCollarLength(stem, direction);
+	float ratio = setPath(stem, 0.0f, direction, l, root->getData(),
+		random);
+	addStems(stem, ratio, 0.0f, root, 0);
+	pool.wait();
+	this->pool = nullptr;
+	this->mutex = nullptr;
+	this->parameterTree.clean();
+	stem->setParameterTree(this->parameterTree);
+}
+
+Stem *PatternGenerator::addStem(Stem *parent)
+{
+	std::lock_guard<std::mutex> lock(*this->mutex);
+	return this->plant->addStem(parent);
 }
 
 float getForkCollarLength(Vec3 direction1, Vec3 direction2, float radius)
@@ -84,8 +255,11 @@ float getForkCollarLength(Vec3 direction1, Vec3 direction2, float radius)
 	return std::sin(0.5f*pi-t) / std::sin(t) * radius * 1.1f;
 }
 
+/** Add forks and lateral stems. Forks are added right away because the
+length of the stem includes them. The random numbers of each stem come from
+a stream that is derived from the stream of its parent. */
 float PatternGenerator::addStems(Stem *stem, float ratio, float length,
-	const ParameterNode *node)
+	const ParameterNode *node, uint64_t stream)
 {
 	const StemData &data = node->getData();
 	float totalLength = length + stem->getPath().getLength();
@@ -94,31 +268,41 @@ float PatternGenerator::addStems(Stem *stem, float ratio, float length,
 		stem->setMinRadius(0.0f);
 	else {
 		float radius = stem->getMinRadius() * data.forkScale;
-		Vec3 d1 = getForkDirection(stem, 1.0f, data);
-		Vec3 d2 = getForkDirection(stem, -1.0f, data);
+		uint64_t stream1 = Philox::getStream(stream, 0, 1);
+		uint64_t stream2 = Philox::getStream(stream, 0, 2);
+		Philox random1(this->seed, stream1);
+		Philox random2(this->seed, stream2);
+		Vec3 d1 = getForkDirection(stem, 1.0f, data, random1);
+		Vec3 d2 = getForkDirection(stem, -1.0f, data, random2);
 		float collarLength = getForkCollarLength(d1, d2, radius);
 
-		Stem *fork1 = plant->addStem(stem);
+		Stem *fork1 = addStem(stem);
 		fork1->setMaxRadius(radius);
 		fork1->setDistance(std::numeric_limits<float>::max());
 		fork1->setSectionDivisions(stem->getSectionDivisions());
-		ratio = setPath(fork1, ratio, d1, collarLength, data);
-		float l1 = addStems(fork1, ratio, totalLength, node);
+		ratio = setPath(fork1, ratio, d1, collarLength, data, random1);
+		float l1 = addStems(fork1, ratio, totalLength, node, stream1);
 
-		Stem *fork2 = plant->addStem(stem);
+		Stem *fork2 = addStem(stem);
 		fork2->setMaxRadius(radius);
 		fork2->setDistance(std::numeric_limits<float>::max());
 		fork2->setSectionDivisions(stem->getSectionDivisions());
-		ratio = setPath(fork2, ratio, d2, collarLength, data);
-		float l2 = addStems(fork2, ratio, totalLength, node);
+		ratio = setPath(fork2, ratio, d2, collarLength, data, random2);
+		float l2 = addStems(fork2, ratio, totalLength, node, stream2);
 
 		totalLength = l1 > l2 ? l1 : l2;
 	}
 
+	PatternState *state = stem->getPatternState();
+	state->node = this->indices.at(node);
+	state->stream = stream;
+	state->length = length;
+	state->totalLength = totalLength;
+
 	node = node->getChild();
-	while (node) {
+	for (int i = 1; node; i++) {
 		Length l(length, totalLength);
-		addLateralStems(stem, l, node);
+		addLateralStems(stem, l, node, Philox::getStream(stream, i, 0));
 		addLeaves(stem, l, node->getData().leaf);
 		node = node->getSibling();
 	}
@@ -127,9 +311,9 @@ float PatternGenerator::addStems(Stem *stem, float ratio, float length,
 }
 
 void PatternGenerator::addLateralStems(Stem *parent, Length length,
-	const ParameterNode *node)
+	const ParameterNode *node, uint64_t stream)
 {
-	StemData stemData = node->getData();
+	const StemData &stemData = node->getData();
 	if (stemData.density == 0.0f)
 		return;
 
@@ -150,23 +334,25 @@ void PatternGenerator::addLateralStems(Stem *parent, Length length,
 		float r = stemData.densityCurve.getPoint(t).y;
 		if (r == 0.0f)
 			break;
-		addLateralStem(parent, position, length, i, d1, d2, node);
+		addLateralStem(parent, position, length, i, d1, d2, node,
+			Philox::getStream(stream, i, 0));
 		position -= distance * (1.0f/r);
 	}
 }
 
 void PatternGenerator::addLateralStem(Stem *parent, float position,
 	Length length, int index, Vec3 &direction1, Vec3 &direction2,
-	const ParameterNode *node)
+	const ParameterNode *node, uint64_t stream)
 {
-	StemData data = node->getData();
+	const StemData &data = node->getData();
+	Philox random(this->seed, stream);
 	Vec2 collar(1.5f, 3.0f);
 	float radius = this->plant->getIntermediateRadius(parent, position);
-	radius = modifyRadius(data, radius / collar.x);
+	radius = modifyRadius(data, radius / collar.x, random);
 	if (radius < data.radiusThreshold)
 		return;
 
-	Stem *stem = plant->addStem(parent);
+	Stem *stem = addStem(parent);
 	stem->setMaxRadius(radius);
 	stem->setSwelling(collar);
 	stem->setDistance(position);
@@ -182,19 +368,23 @@ void PatternGenerator::addLateralStem(Stem *parent, float position,
 	direction2 = d;
 	direction1 = rotate(r, direction1);
 
-	d = getDirection(stem, index, length, direction1, direction2, data);
+	d = getDirection(stem, index, length, direction1, direction2, data,
+		random);
 	float collarLength = getCollarLength(stem, d);
 	float ratio = (stem->getDistance() + length.current) / length.total;
-	ratio = setPath(stem, ratio, d, collarLength, data);
-	addStems(stem, ratio, collarLength, node);
+	ratio = setPath(stem, ratio, d, collarLength, data, random);
+	this->pool->spawn([this, stem, ratio, collarLength, node, stream]() {
+		addStems(stem, ratio, collarLength, node, stream);
+	});
 }
 
-float PatternGenerator::modifyRadius(const StemData &data, float radius)
+float PatternGenerator::modifyRadius(const StemData &data, float radius,
+	Philox &random)
 {
 	float variation = 1.0f;
 	if (data.radiusVariation > 0.0f) {
 		std::normal_distribution<float> dis(1.0f, data.radiusVariation);
-		variation = dis(this->mt);
+		variation = dis(random);
 		if (variation > 1.0f)
 			variation = 1.0f;
 	}
@@ -202,12 +392,13 @@ float PatternGenerator::modifyRadius(const StemData &data, float radius)
 }
 
 Vec3 PatternGenerator::getDirection(Stem *stem, int index, Length length,
-	Vec3 direction1, Vec3 direction2, const StemData &data)
+	Vec3 direction1, Vec3 direction2, const StemData &data,
+	Philox &random)
 {
 	float variation = data.angleVariation * pi;
 	std::uniform_real_distribution<float> dis1(-variation, variation);
 	float ratio = (stem->getDistance() + length.current) / length.total;
-	float radialAngle = data.leaf.rotation*index + dis1(this->mt);
+	float radialAngle = data.leaf.rotation*index + dis1(random);
 	Quat radialRotation = fromAxisAngle(direction2, radialAngle);
 	direction1 = normalize(direction1);
 	direction1 = rotate(radialRotation, direction1);
@@ -217,7 +408,7 @@ Vec3 PatternGenerator::getDirection(Stem *stem, int index, Length length,
 	if (data.inclineVariation > 0.0f) {
 		std::normal_distribution<float> dis2(
 			0.0f, data.inclineVariation);
-		t += dis2(this->mt);
+		t += dis2(random);
 	}
 	if (t < 0.0f) {
 		t *= -1.0f;
@@ -230,7 +421,7 @@ Vec3 PatternGenerator::getDirection(Stem *stem, int index, Length length,
 }
 
 Vec3 PatternGenerator::getForkDirection(Stem *stem, float sign,
-	const StemData &data)
+	const StemData &data, Philox &random)
 {
 	float minAngle = 0.1f;
 	float maxAngle = data.forkAngle;
@@ -245,7 +436,7 @@ Vec3 PatternGenerator::getForkDirection(Stem *stem, float sign,
 	if (parentDirection != up)
 		normal = normalize(cross(parentDirection, up));
 	normal = normalize(cross(normal, parentDirection));
-	float angle = sign * dis(this->mt);
+	float angle = sign * dis(random);
 
 	return rotateAroundAxis(parentDirection, normal, angle);
 }
@@ -266,7 +457,7 @@ float PatternGenerator::getCollarLength(Stem *stem, Vec3 direction)
 }
 
 float PatternGenerator::setPath(Stem *stem, float ratio, Vec3 direction,
-	float collarLength, const StemData &data)
+	float collarLength, const StemData &data, Philox &random)
 {
 	if (stem->isCustom())
 		return 1.0f;
@@ -291,7 +482,7 @@ float PatternGenerator::setPath(Stem *stem, float ratio, Vec3 direction,
 	for (int i = 0; i < points; i++) {
 		if (i < points-1) {
 			float t = i*increment / length;
-			ratio = bifurcatePath(stem, t, data);
+			ratio = bifurcatePath(stem, t, data, random);
 		}
 		if (ratio != 1.0f) {
 			increment = 2.0f * radius;
@@ -301,38 +492,38 @@ float PatternGenerator::setPath(Stem *stem, float ratio, Vec3 direction,
 		}
 
 		Vec3 change = direction;
-		change.x += dis(this->mt) * data.noise;
-		change.y += dis(this->mt) * data.noise;
-		change.z += dis(this->mt) * data.noise;
+		change.x += dis(random) * data.noise;
+		change.y += dis(random) * data.noise;
+		change.z += dis(random) * data.noise;
 		control += increment * normalize(change);
 		controls.push_back(control);
 
 		float scale = 0.1f/(1.0f+pi*radius*radius*length);
 		float pull = sqrt(control.x*control.x + control.y*control.y);
-		change.x = dis(this->mt) * scale;
-		change.y = dis(this->mt) * scale;
-		change.z = dis(this->mt) * scale;
+		change.x = dis(random) * scale;
+		change.y = dis(random) * scale;
+		change.z = dis(random) * scale;
 		change.z -= data.gravity * pull;
 		direction = normalize(direction + change);
 	}
 
 	Spline spline;
 	spline.setDegree(1);
-	spline.setControls(controls);
-	path.setSpline(spline);
-	stem->setPath(path);
+	spline.setControls(std::move(controls));
+	path.setSpline(std::move(spline));
+	stem->setPath(std::move(path));
 	return 1.0f - ratio;
 }
 
 float PatternGenerator::bifurcatePath(Stem *stem, float ratio,
-	const StemData &data)
+	const StemData &data, Philox &random)
 {
 	int depth = stem->getDepth();
 	std::bernoulli_distribution dis(data.fork);
-	if (dis(this->mt) && depth <= this->maxDepth) {
+	if (dis(random) && depth <= this->maxDepth) {
 		float radius = stem->getMaxRadius();
 		unsigned curve = stem->getRadiusCurve();
-		Spline spline = this->plant->getCurve(curve).getSpline();
+		const Spline &spline = this->plant->getCurve(curve).getSpline();
 		radius *= spline.getPoint(ratio).y;
 		if (radius > data.radiusThreshold) {
 			stem->setMinRadius(radius);
@@ -342,7 +533,8 @@ float PatternGenerator::bifurcatePath(Stem *stem, float ratio,
 	return 1.0f;
 }
 
-void PatternGenerator::addLeaves(Stem *stem, Length length, LeafData data)
+void PatternGenerator::addLeaves(Stem *stem, Length length,
+	const LeafData &data)
 {
 	if (data.density <= 0.0f || data.leavesPerNode < 1)
 		return;
@@ -16,8 +16,13 @@
 #ifndef PG_PATTERN_GENERATOR_H
 #define PG_PATTERN_GENERATOR_H
 
+#include "parallel.h"
+#include "philox.h"
 #include "plant.h"
+#include <mutex>
 #include <random>
+#include <unordered_map>
+#include <vector>
 
 namespace pg {
 	class PatternGenerator {
@@ -29,27 +34,56 @@ namespace pg {
 
 		Plant *plant;
 		int maxDepth;
+		uint64_t seed;
+		int threads;
 		ParameterTree parameterTree;
-		std::mt19937 mt;
+		/* Tasks and the lock for adding stems while growing. */
+		TaskPool *pool;
+		std::mutex *mutex;
+		/* Parameter nodes in depth-first order and their positions,
+		which stems refer to. */
+		std::vector<const ParameterNode *> nodes;
+		std::unordered_map<const ParameterNode *, int> indices;
 
-		void addLateralStems(Stem *, Length, const ParameterNode *);
+		const ParameterNode *getParameterRoot() const;
+		void indexNodes(const ParameterNode *);
+		bool isGenerated(const Stem *, const ParameterNode *) const;
+		void updateStems(Stem *);
+		void growStem(Stem *, Vec3);
+		Stem *addStem(Stem *);
+		void addLateralStems(Stem *, Length, const ParameterNode *,
+			uint64_t);
 		void addLateralStem(Stem *, float, Length, int, Vec3 &, Vec3 &,
-			const ParameterNode *);
-		float modifyRadius(const StemData &, float);
+			const ParameterNode *, uint64_t);
+		float modifyRadius(const StemData &, float, Philox &);
 		Vec3 getDirection(Stem *, int, Length, Vec3, Vec3,
-			const StemData &);
-		Vec3 getForkDirection(Stem *, float, const StemData &);
-		float addStems(Stem *, float, float, const ParameterNode *);
+			const StemData &, Philox &);
+		Vec3 getForkDirection(Stem *, float, const StemData &,
+			Philox &);
+		float addStems(Stem *, float, float, const ParameterNode *,
+			uint64_t);
 		float getCollarLength(Stem *, Vec3);
-		float setPath(Stem *, float, Vec3, float, const StemData &);
-		float bifurcatePath(Stem *, float, const StemData &);
-		void addLeaves(Stem *, Length, LeafData);
+		float setPath(Stem *, float, Vec3, float, const StemData &,
+			Philox &);
+		float bifurcatePath(Stem *, float, const StemData &, Philox &);
+		void addLeaves(Stem *, Length, const LeafData &);
 
 	public:
 		PatternGenerator(Plant *plant);
 		void grow();
 		void grow(Stem *stem);
+		/** Grow the stems of parameter nodes that are marked as dirty
+		again and keep the other stems. Return false without changing
+		the plant if the stems were not grown from the same parameter
+		tree or if the root node is dirty. */
+		bool update(Stem *stem);
 		void reset();
+		/** Set the number of threads that stems are added with. The
+		random numbers of a stem only depend on the seed and on the
+		stems and parameter nodes that lead to it, so the plant is the
+		same for any number of threads. */
+		void setThreads(int threads);
+		int getThreads() const;
 		void setParameterTree(ParameterTree parameterTree);
 		ParameterTree getParameterTree() const;
 	};
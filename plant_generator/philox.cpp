@@ -0,0 +1,107 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "philox.h"
+
+using pg::Philox;
+
+Philox::Philox(uint64_t key, uint64_t stream)
+{
+	seed(key, stream);
+}
+
+void Philox::seed(uint64_t key, uint64_t stream)
+{
+	this->key[0] = key;
+	this->key[1] = key >> 32;
+	this->counter[0] = 0;
+	this->counter[1] = 0;
+	this->counter[2] = stream;
+	this->counter[3] = stream >> 32;
+	this->index = 4;
+}
+
+Philox::result_type Philox::operator()()
+{
+	if (this->index == 4)
+		generate();
+	return this->output[this->index++];
+}
+
+void Philox::discard(unsigned long long count)
+{
+	while (count > 0 && this->index < 4) {
+		this->index++;
+		count--;
+	}
+	if (count == 0)
+		return;
+
+	/* Skip whole blocks and generate the block of the next number. */
+	uint64_t blocks = count / 4;
+	uint64_t block = this->counter[0] | (uint64_t)this->counter[1] << 32;
+	block += blocks;
+	this->counter[0] = block;
+	this->counter[1] = block >> 32;
+	generate();
+	this->index = count % 4;
+}
+
+/** Compute the next block and advance the counter. */
+void Philox::generate()
+{
+	getBlock(this->key, this->counter, this->output);
+	this->index = 0;
+	if (++this->counter[0] == 0)
+		this->counter[1]++;
+}
+
+void Philox::getBlock(const uint32_t key[2], const uint32_t counter[4],
+	uint32_t block[4])
+{
+	const uint64_t m0 = 0xD2511F53;
+	const uint64_t m1 = 0xCD9E8D57;
+	uint32_t k0 = key[0];
+	uint32_t k1 = key[1];
+	uint32_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+	for (int i = 0; i < 10; i++) {
+		uint64_t p0 = m0 * c[0];
+		uint64_t p1 = m1 * c[2];
+		uint32_t hi0 = p0 >> 32;
+		uint32_t hi1 = p1 >> 32;
+		c[0] = hi1 ^ c[1] ^ k0;
+		c[1] = p1;
+		c[2] = hi0 ^ c[3] ^ k1;
+		c[3] = p0;
+		k0 += 0x9E3779B9;
+		k1 += 0xBB67AE85;
+	}
+	for (int i = 0; i < 4; i++)
+		block[i] = c[i];
+}
+
+/** Mix the numbers with the finalizer of SplitMix64 so that similar
+lineages lead to unrelated streams. */
+uint64_t Philox::getStream(uint64_t stream, uint64_t a, uint64_t b)
+{
+	uint64_t values[2] = {a, b};
+	for (uint64_t value : values) {
+		stream += 0x9E3779B97F4A7C15 + value;
+		stream = (stream ^ (stream >> 30)) * 0xBF58476D1CE4E5B9;
+		stream = (stream ^ (stream >> 27)) * 0x94D049BB133111EB;
+		stream ^= stream >> 31;
+	}
+	return stream;
+}
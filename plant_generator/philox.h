@@ -0,0 +1,61 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PG_PHILOX_H
+#define PG_PHILOX_H
+
+#include <cstdint>
+
+namespace pg {
+	/** A counter-based random number generator (Philox4x32-10 by Salmon
+	et al.). Numbers are a function of a key, a stream and their position
+	in the stream, so any stream can be used without generating the
+	streams before it. The generator can be used with the distributions
+	of the standard library. */
+	class Philox {
+		uint32_t key[2];
+		uint32_t counter[4];
+		uint32_t output[4];
+		int index;
+
+		void generate();
+
+	public:
+		typedef uint32_t result_type;
+
+		Philox(uint64_t key = 0, uint64_t stream = 0);
+		void seed(uint64_t key, uint64_t stream = 0);
+		result_type operator()();
+		void discard(unsigned long long count);
+		/** Return the four numbers of a block of the stream. */
+		static void getBlock(const uint32_t key[2],
+			const uint32_t counter[4], uint32_t block[4]);
+		/** Combine a stream with two numbers to get another stream. */
+		static uint64_t getStream(uint64_t stream, uint64_t a,
+			uint64_t b);
+
+		static constexpr result_type min()
+		{
+			return 0;
+		}
+
+		static constexpr result_type max()
+		{
+			return UINT32_MAX;
+		}
+	};
+}
+
+#endif
@@ -20,7 +20,7 @@ using namespace pg;
 using std::vector;
 using std::pair;
 
-Plant::Plant() : root(nullptr)
+Plant::Plant() : root(nullptr), curveRevision(1)
 {
 
 }
@@ -70,6 +70,39 @@ Stem *Plant::move(Stem *value)
 	return stem;
 }
 
+size_t Plant::compact()
+{
+	size_t bytes = this->stemPool.getOccupancy().bytes;
+	StemPool pool(this->stemPool.getPoolCapacity());
+	if (this->root)
+		this->root = relocate(this->root, nullptr, pool);
+	this->stemPool.swap(pool);
+	return bytes - this->stemPool.getOccupancy().bytes;
+}
+
+/** Move a stem and then its descendants to another pool. */
+Stem *Plant::relocate(Stem *stem, Stem *parent, StemPool &pool)
+{
+	Stem *copy = pool.allocate();
+	copy->relocate(*stem);
+	copy->parent = parent;
+	copy->child = nullptr;
+	copy->prevSibling = nullptr;
+	copy->nextSibling = nullptr;
+
+	Stem *prevChild = nullptr;
+	for (Stem *child = stem->child; child; child = child->nextSibling) {
+		Stem *childCopy = relocate(child, copy, pool);
+		childCopy->prevSibling = prevChild;
+		if (prevChild)
+			prevChild->nextSibling = childCopy;
+		else
+			copy->child = childCopy;
+		prevChild = childCopy;
+	}
+	return copy;
+}
+
 StemPool *Plant::getStemPool()
 {
 	return &this->stemPool;
@@ -117,6 +150,15 @@ void Plant::decouple(Stem *stem)
 	}
 }
 
+void Plant::moveToFront(Stem *stem)
+{
+	Stem *parent = stem->parent;
+	if (parent && parent->child != stem) {
+		decouple(stem);
+		insertStemAtBeginning(stem, parent);
+	}
+}
+
 Stem *Plant::getRoot()
 {
 	return this->root;
@@ -211,6 +253,27 @@ void Plant::deleteStem(Stem *stem)
 	deallocateStems(stem);
 }
 
+void Plant::deleteStems(const vector<Stem *> &stems)
+{
+	vector<Stem *> descendants;
+	for (Stem *stem : stems) {
+		decouple(stem);
+		getStems(stem, descendants);
+	}
+	this->stemPool.deallocate(descendants);
+}
+
+/** Append the descendants of a stem followed by the stem itself. */
+void Plant::getStems(Stem *stem, vector<Stem *> &stems)
+{
+	Stem *child = stem->child;
+	while (child) {
+		getStems(child, stems);
+		child = child->nextSibling;
+	}
+	stems.push_back(stem);
+}
+
 void Plant::copy(vector<Stem> &stems, Stem *stem)
 {
 	Stem *child = stem->child;
@@ -272,16 +335,35 @@ void Plant::reinsertStems(vector<Stem> &extractions)
 
 float Plant::getRadius(Stem *stem, unsigned index) const
 {
+	if (stem->radii.empty() || stem->radiiRevision != this->curveRevision)
+		updateRadii(stem);
+	if (index < stem->radii.size())
+		return stem->radii[index];
+
 	float t = stem->path.getPercentage(index);
-	const Spline spline = this->curves[stem->getRadiusCurve()].getSpline();
+	const Spline &spline = this->curves[stem->getRadiusCurve()].getSpline();
 	float z = spline.getPoint(t).y;
 	return z * (stem->maxRadius - stem->minRadius) + stem->minRadius;
 }
 
+void Plant::updateRadii(Stem *stem) const
+{
+	const Spline &spline = this->curves[stem->radiusCurve].getSpline();
+	float range = stem->maxRadius - stem->minRadius;
+	size_t size = stem->path.getSize();
+	stem->radii.resize(size);
+	for (size_t i = 0; i < size; i++) {
+		float t = stem->path.getPercentage(i);
+		float z = spline.getPoint(t).y;
+		stem->radii[i] = z * range + stem->minRadius;
+	}
+	stem->radiiRevision = this->curveRevision;
+}
+
 float Plant::getIntermediateRadius(Stem *stem, float t) const
 {
 	float length = stem->path.getLength();
-	const Spline spline = this->curves[stem->getRadiusCurve()].getSpline();
+	const Spline &spline = this->curves[stem->getRadiusCurve()].getSpline();
 	float z = spline.getPoint(t / length).y;
 	return z * (stem->maxRadius - stem->minRadius) + stem->minRadius;
 }
@@ -298,11 +380,13 @@ float Plant::getRadiusAt(Stem *stem)
 void Plant::addCurve(Curve curve)
 {
 	this->curves.push_back(curve);
+	this->curveRevision++;
 }
 
 void Plant::updateCurve(Curve curve, unsigned index)
 {
 	this->curves[index] = curve;
+	this->curveRevision++;
 }
 
 void Plant::removeCurve(unsigned index)
@@ -310,6 +394,7 @@ void Plant::removeCurve(unsigned index)
 	if (this->root)
 		removeCurve(this->root, index);
 	this->curves.erase(this->curves.begin()+index);
+	this->curveRevision++;
 }
 
 void Plant::removeCurve(Stem *stem, unsigned index)
@@ -327,7 +412,7 @@ void Plant::removeCurve(Stem *stem, unsigned index)
 	}
 }
 
-Curve Plant::getCurve(unsigned index) const
+const Curve &Plant::getCurve(unsigned index) const
 {
 	return this->curves.at(index);
 }
@@ -443,5 +528,6 @@ void Plant::erase()
 	this->leafMeshes.clear();
 	this->materials.clear();
 	this->curves.clear();
+	this->curveRevision++;
 	this->removeRoot();
 }
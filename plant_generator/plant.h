@@ -45,6 +45,15 @@ namespace pg {
 		Stem *createRoot();
 		/** Delete a stem. */
 		void deleteStem(Stem *stem);
+		/** Delete several stems with their descendants at once. A stem
+		must not be the descendant of another stem in the list. */
+		void deleteStems(const std::vector<Stem *> &stems);
+		/** Move a stem in front of its siblings. */
+		void moveToFront(Stem *stem);
+		/** Move the stems into as few pools as possible in depth-first
+		order and release the other pools. Pointers to stems are invalid
+		afterwards. Return the number of bytes that were released. */
+		size_t compact();
 		/** Return the root or trunk of the plant. */
 		Stem *getRoot();
 		const Stem *getRoot() const;
@@ -62,6 +71,10 @@ namespace pg {
 		/** Reinsert extracted stems. */
 		void reinsertStems(std::vector<Stem> &stem);
 
+		/** Return the radius at a point of the path. The radii of a
+		stem are computed once and kept until the path, the radii or
+		the curves change. The cache is filled on first read, so
+		concurrent reads of the same stem are not allowed. */
 		float getRadius(Stem *stem, unsigned index) const;
 		float getIntermediateRadius(Stem *stem, float t) const;
 		float getRadiusAt(Stem *stem);
@@ -69,7 +82,7 @@ namespace pg {
 		void addCurve(Curve curve);
 		void updateCurve(Curve curve, unsigned index);
 		void removeCurve(unsigned index);
-		Curve getCurve(unsigned index) const;
+		const Curve &getCurve(unsigned index) const;
 		const std::vector<Curve> &getCurves() const;
 
 		void addMaterial(Material material);
@@ -89,13 +102,17 @@ namespace pg {
 		std::vector<Material> materials;
 		std::vector<Geometry> leafMeshes;
 		std::vector<Curve> curves;
+		/* Changes with the curves to discard the radii of stems. */
+		unsigned curveRevision;
 		StemPool stemPool;
 
 		void removeCurve(Stem *, unsigned);
 		void removeMaterial(Stem *, unsigned);
 		void removeLeafMesh(Stem *, unsigned);
+		void updateRadii(Stem *) const;
 
 		void deallocateStems(Stem *);
+		void getStems(Stem *, std::vector<Stem *> &);
 		void insertStem(Stem *, Stem *, Stem *);
 		void insertStemAfterSibling(Stem *, Stem *, Stem *);
 		void insertStemBeforeSibling(Stem *, Stem *, Stem *);
@@ -103,6 +120,7 @@ namespace pg {
 		Stem *getLastSibling(Stem *);
 		void decouple(Stem *);
 		Stem *move(Stem *);
+		Stem *relocate(Stem *, Stem *, StemPool &);
 		void copy(std::vector<Stem> &, Stem *);
 
 #ifdef PG_SERIALIZE
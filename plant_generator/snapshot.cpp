@@ -0,0 +1,119 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "snapshot.h"
+
+using namespace pg;
+
+Snapshot::Snapshot()
+{
+	this->pointOffsets.push_back(0);
+	this->leafOffsets.push_back(0);
+}
+
+Snapshot::Snapshot(Plant *plant)
+{
+	this->pointOffsets.push_back(0);
+	this->leafOffsets.push_back(0);
+	if (plant->getRoot())
+		addStems(plant, plant->getRoot(), -1);
+}
+
+/** Append a stem, then its descendants and then its next siblings. */
+void Snapshot::addStems(Plant *plant, Stem *stem, int parent)
+{
+	while (stem) {
+		int index = this->stems.size();
+		const Path &path = stem->getPath();
+		Vec3 location = stem->getLocation();
+		this->stems.push_back(stem);
+		this->parents.push_back(parent);
+		this->depths.push_back(stem->getDepth());
+		this->locations.push_back(location);
+
+		size_t size = path.getSize();
+		for (size_t i = 0; i < size; i++) {
+			this->points.push_back(location + path.get(i));
+			this->radii.push_back(plant->getRadius(stem, i));
+		}
+		this->pointOffsets.push_back(this->points.size());
+
+		for (const Leaf &leaf : stem->getLeaves()) {
+			float position = leaf.getPosition();
+			Vec3 point = path.getIntermediate(position);
+			this->leaves.push_back(leaf);
+			this->leafLocations.push_back(location + point);
+		}
+		this->leafOffsets.push_back(this->leaves.size());
+
+		addStems(plant, stem->getChild(), index);
+		stem = stem->getSibling();
+	}
+}
+
+size_t Snapshot::getStemCount() const
+{
+	return this->stems.size();
+}
+
+const std::vector<const Stem *> &Snapshot::getStems() const
+{
+	return this->stems;
+}
+
+const std::vector<int> &Snapshot::getParents() const
+{
+	return this->parents;
+}
+
+const std::vector<int> &Snapshot::getDepths() const
+{
+	return this->depths;
+}
+
+const std::vector<Vec3> &Snapshot::getLocations() const
+{
+	return this->locations;
+}
+
+const std::vector<size_t> &Snapshot::getPointOffsets() const
+{
+	return this->pointOffsets;
+}
+
+const std::vector<Vec3> &Snapshot::getPoints() const
+{
+	return this->points;
+}
+
+const std::vector<float> &Snapshot::getRadii() const
+{
+	return this->radii;
+}
+
+const std::vector<size_t> &Snapshot::getLeafOffsets() const
+{
+	return this->leafOffsets;
+}
+
+const std::vector<Leaf> &Snapshot::getLeaves() const
+{
+	return this->leaves;
+}
+
+const std::vector<Vec3> &Snapshot::getLeafLocations() const
+{
+	return this->leafLocations;
+}
@@ -0,0 +1,70 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PG_SNAPSHOT_H
+#define PG_SNAPSHOT_H
+
+#include "leaf.h"
+#include "plant.h"
+#include "stem.h"
+#include "math/vec3.h"
+#include <vector>
+
+namespace pg {
+	/** A read-only copy of the stems of a plant in depth-first order.
+	Stems refer to their parent and to ranges of the point and leaf arrays
+	by index, so that the arrays can be processed with loops instead of
+	following the pointers of stems. The snapshot does not change with the
+	plant. */
+	class Snapshot {
+		std::vector<const Stem *> stems;
+		std::vector<int> parents;
+		std::vector<int> depths;
+		std::vector<Vec3> locations;
+		std::vector<size_t> pointOffsets;
+		std::vector<Vec3> points;
+		std::vector<float> radii;
+		std::vector<size_t> leafOffsets;
+		std::vector<Leaf> leaves;
+		std::vector<Vec3> leafLocations;
+
+		void addStems(Plant *, Stem *, int);
+
+	public:
+		Snapshot();
+		Snapshot(Plant *plant);
+		size_t getStemCount() const;
+		/** The stems that the arrays were copied from. */
+		const std::vector<const Stem *> &getStems() const;
+		/** The index of the parent of each stem or -1 for the root. A
+		parent is always before its descendants. */
+		const std::vector<int> &getParents() const;
+		const std::vector<int> &getDepths() const;
+		const std::vector<Vec3> &getLocations() const;
+		/** The points of stem i are in [offsets[i], offsets[i+1]). */
+		const std::vector<size_t> &getPointOffsets() const;
+		/** Path points with the location of their stem added. */
+		const std::vector<Vec3> &getPoints() const;
+		/** The radius at each path point. */
+		const std::vector<float> &getRadii() const;
+		/** The leaves of stem i are in [offsets[i], offsets[i+1]). */
+		const std::vector<size_t> &getLeafOffsets() const;
+		const std::vector<Leaf> &getLeaves() const;
+		/** The location of each leaf on its stem. */
+		const std::vector<Vec3> &getLeafLocations() const;
+	};
+}
+
+#endif
@@ -15,6 +15,8 @@
 
 #include "spline.h"
 #include "math/curve.h"
+#include <algorithm>
+#include <cmath>
 
 using pg::Spline;
 using pg::Vec3;
@@ -80,15 +82,17 @@ void Spline::setDefault(unsigned type)
 
 void Spline::setControls(std::vector<Vec3> controls)
 {
-	this->controls = controls;
+	this->controls = std::move(controls);
+	this->table.reset();
 }
 
 void Spline::addControl(Vec3 control)
 {
 	this->controls.push_back(control);
+	this->table.reset();
 }
 
-std::vector<Vec3> Spline::getControls() const
+const std::vector<Vec3> &Spline::getControls() const
 {
 	return controls;
 }
@@ -106,6 +110,7 @@ int Spline::getCurveCount() const
 void Spline::setDegree(int degree)
 {
 	this->degree = degree;
+	this->table.reset();
 }
 
 int Spline::getDegree() const
@@ -113,8 +118,83 @@ int Spline::getDegree() const
 	return degree;
 }
 
+void Spline::compile(float tolerance)
+{
+	this->table.reset();
+	if (getCurveCount() == 0)
+		return;
+	float start = this->controls.front().x;
+	float end = this->controls.back().x;
+	if (!(end > start))
+		return;
+
+	/* Double the number of samples until the table is accurate enough.
+	Curves that are not smooth, such as linear curves with corners
+	between samples, might never be and are evaluated directly. */
+	for (size_t size = 16; size <= 1024; size *= 2) {
+		std::shared_ptr<Table> table = std::make_shared<Table>();
+		table->start = start;
+		table->scale = size / (end - start);
+		table->points.resize(size + 1);
+		for (size_t i = 0; i <= size; i++)
+			table->points[i] = evaluate(start + i / table->scale);
+		if (getError(*table) <= tolerance) {
+			this->table = table;
+			break;
+		}
+	}
+}
+
+/** Return the largest difference between the curves and the interpolated
+points between samples. */
+float Spline::getError(const Table &table) const
+{
+	float error = 0.0f;
+	size_t size = table.points.size() - 1;
+	for (size_t i = 0; i < size; i++) {
+		for (float f : {0.25f, 0.5f, 0.75f}) {
+			Vec3 a = table.points[i];
+			Vec3 b = table.points[i+1];
+			Vec3 d = a + f * (b - a);
+			d -= evaluate(table.start + (i + f) / table.scale);
+			error = std::max(error, std::abs(d.x));
+			error = std::max(error, std::abs(d.y));
+			error = std::max(error, std::abs(d.z));
+		}
+	}
+	return error;
+}
+
+bool Spline::isCompiled() const
+{
+	return this->table != nullptr;
+}
+
 Vec3 Spline::getPoint(float t) const
 {
+	if (!this->table)
+		return evaluate(t);
+
+	const Table &table = *this->table;
+	size_t size = table.points.size() - 1;
+	/* Values outside of the table are clamped to its ends so that the
+	points stay continuous. */
+	float u = (t - table.start) * table.scale;
+	if (!(u >= 0.0f))
+		u = 0.0f;
+	else if (u > size)
+		u = size;
+	size_t i = std::min((size_t)u, size - 1);
+	float f = u - i;
+	return table.points[i] + f * (table.points[i+1] - table.points[i]);
+}
+
+/** Values outside of the curves are clamped to the first and last controls,
+which is what a compiled spline returns as well. */
+Vec3 Spline::evaluate(float t) const
+{
+	if (!(t >= controls.front().x))
+		return controls.front();
 	for (size_t i = 0; i < controls.size()-degree; i += degree) {
 		if (controls[i].x <= t && controls[i+degree].x >= t) {
 			t -= controls[i].x;
@@ -131,7 +211,7 @@ Vec3 Spline::getPoint(int curve, float t) const
 	return getBezier(t, &controls[index], (degree + 1));
 }
 
-Vec3 Spline::getDirection(unsigned index)
+Vec3 Spline::getDirection(unsigned index) const
 {
 	if (index == controls.size() - 1)
 		return pg::normalize(controls[index] - controls[index - 1]);
@@ -141,6 +221,7 @@ Vec3 Spline::getDirection(unsigned index)
 
 int Spline::insert(unsigned index, Vec3 point)
 {
+	this->table.reset();
 	if (degree == 1) {
 		controls.insert(controls.begin() + index + 1, point);
 		return index + 1;
@@ -211,6 +292,7 @@ int Spline::insertCubic(int index, Vec3 point)
 
 void Spline::remove(unsigned index)
 {
+	this->table.reset();
 	if (degree == 1)
 		controls.erase(controls.begin() + index);
 	else if (degree == 3)
@@ -238,6 +320,7 @@ void Spline::removeCubic(unsigned index)
 
 void Spline::adjust(int degree)
 {
+	this->table.reset();
 	if (this->degree == degree)
 		return;
 	else if (degree == 1)
@@ -289,6 +372,7 @@ void Spline::adjustCubic()
 
 void Spline::move(unsigned index, Vec3 location, bool parallel)
 {
+	this->table.reset();
 	if (degree == 3)
 		moveCubic(index, location, parallel);
 	else
@@ -320,6 +404,7 @@ void Spline::moveCubic(unsigned index, Vec3 location, bool parallel)
 
 void Spline::parallelize(unsigned index)
 {
+	this->table.reset();
 	if (degree != 3)
 		return;
 
@@ -348,6 +433,7 @@ void Spline::parallelize(unsigned index)
 
 void Spline::linearize(int curve)
 {
+	this->table.reset();
 	if (degree != 3)
 		return;
 
@@ -362,4 +448,5 @@ void Spline::linearize(int curve)
 void Spline::clear()
 {
 	controls.clear();
+	this->table.reset();
 }
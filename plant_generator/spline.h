@@ -17,6 +17,7 @@
 #define PG_SPLINE_H
 
 #include "math/vec3.h"
+#include <memory>
 #include <vector>
 #include <set>
 
@@ -27,9 +28,20 @@
 
 namespace pg {
 	class Spline {
+		/* Points sampled at equal intervals of the first coordinate. */
+		struct Table {
+			float start;
+			float scale;
+			std::vector<Vec3> points;
+		};
+
 		std::vector<Vec3> controls;
 		int degree;
+		/* Copies share the table, which is never changed once built. */
+		std::shared_ptr<const Table> table;
 
+		Vec3 evaluate(float t) const;
+		float getError(const Table &) const;
 		void adjustCubic();
 		void adjustLinear();
 		int insertCubic(int index, Vec3 point);
@@ -43,6 +55,8 @@ namespace pg {
 		{
 			ar & controls;
 			ar & degree;
+			if (Archive::is_loading::value)
+				table.reset();
 		}
 #endif
 
@@ -54,15 +68,21 @@ namespace pg {
 		void setDefault(unsigned type);
 		void setControls(std::vector<Vec3> controls);
 		void addControl(Vec3 control);
-		std::vector<Vec3> getControls() const;
+		const std::vector<Vec3> &getControls() const;
 		int getSize() const;
 		int getCurveCount() const;
 		/** 1 = linear, 2 = quadratic, 3 = cubic, . . . */
 		void setDegree(int degree);
 		int getDegree() const;
+		/** Build a table of points that getPoint(float) interpolates
+		between instead of evaluating the curves. The table is only
+		built if the interpolated points are within the tolerance of
+		the curves and is discarded when the spline changes. */
+		void compile(float tolerance = 0.0001f);
+		bool isCompiled() const;
 		Vec3 getPoint(float t) const;
 		Vec3 getPoint(int curve, float t) const;
-		Vec3 getDirection(unsigned index);
+		Vec3 getDirection(unsigned index) const;
 		/** Returns the index of the center point of the insertion */
 		int insert(unsigned index, Vec3 point);
 		void remove(unsigned index);
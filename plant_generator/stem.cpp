@@ -24,6 +24,7 @@ Stem::Stem(Stem *parent) :
 	prevSibling(nullptr),
 	child(nullptr),
 	parent(parent),
+	pool(nullptr),
 	depth(0),
 	sectionDivisions(4),
 	radiusCurve(0),
@@ -33,7 +34,8 @@ Stem::Stem(Stem *parent) :
 	maxRadius(0.0f),
 	swelling(1.5f, 3.0f),
 	location(0.0f, 0.0f, 0.0f),
-	custom(false)
+	custom(false),
+	radiiRevision(0)
 {
 	if (parent)
 		this->depth = parent->depth + 1;
@@ -49,6 +51,7 @@ Stem::Stem(const Stem &original) :
 	prevSibling(original.prevSibling),
 	child(original.child),
 	parent(original.parent),
+	pool(nullptr),
 	leaves(original.leaves),
 	joints(original.joints),
 	depth(original.depth),
@@ -62,7 +65,9 @@ Stem::Stem(const Stem &original) :
 	location(original.location),
 	path(original.path),
 	custom(original.custom),
-	parameterTree(original.parameterTree)
+	parameterTree(original.parameterTree),
+	pattern(original.pattern),
+	radiiRevision(0)
 {
 
 }
@@ -87,9 +92,39 @@ Stem &Stem::operator=(const Stem &stem)
 	this->swelling = stem.swelling;
 	this->custom = stem.custom;
 	this->parameterTree = stem.parameterTree;
+	this->pattern = stem.pattern;
+	this->radii.clear();
 	return *this;
 }
 
+/** Take every member of a stem that is moved to another address. */
+void Stem::relocate(Stem &stem)
+{
+	this->nextSibling = stem.nextSibling;
+	this->prevSibling = stem.prevSibling;
+	this->child = stem.child;
+	this->parent = stem.parent;
+	this->leaves = std::move(stem.leaves);
+	this->joints = std::move(stem.joints);
+	this->depth = stem.depth;
+	this->sectionDivisions = stem.sectionDivisions;
+	this->radiusCurve = stem.radiusCurve;
+	this->material[0] = stem.material[0];
+	this->material[1] = stem.material[1];
+	this->distance = stem.distance;
+	this->minRadius = stem.minRadius;
+	this->maxRadius = stem.maxRadius;
+	this->swelling = stem.swelling;
+	this->location = stem.location;
+	this->path = std::move(stem.path);
+	this->custom = stem.custom;
+	this->parameterTree = stem.parameterTree;
+	this->state = stem.state;
+	this->pattern = stem.pattern;
+	this->radii = std::move(stem.radii);
+	this->radiiRevision = stem.radiiRevision;
+}
+
 bool Stem::operator==(const Stem &stem) const
 {
 	return (
@@ -121,6 +156,9 @@ void Stem::init(Stem *parent)
 	this->sectionDivisions = 8;
 	this->custom = false;
 	this->parameterTree.reset();
+	this->state = GeneratorState();
+	this->pattern = PatternState();
+	this->radii.clear();
 	this->nextSibling = nullptr;
 	this->prevSibling = nullptr;
 	this->child = nullptr;
@@ -155,7 +193,7 @@ void Stem::setParameterTree(ParameterTree parameterTree)
 	this->parameterTree = parameterTree;
 }
 
-ParameterTree Stem::getParameterTree() const
+const ParameterTree &Stem::getParameterTree() const
 {
 	return this->parameterTree;
 }
@@ -165,6 +203,21 @@ GeneratorState *Stem::getState()
 	return &this->state;
 }
 
+const GeneratorState *Stem::getState() const
+{
+	return &this->state;
+}
+
+PatternState *Stem::getPatternState()
+{
+	return &this->pattern;
+}
+
+const PatternState *Stem::getPatternState() const
+{
+	return &this->pattern;
+}
+
 size_t Stem::addLeaf(const Leaf &leaf)
 {
 	this->leaves.push_back(leaf);
@@ -215,6 +268,7 @@ void Stem::setCollarDivisions(int divisions)
 {
 	this->path.setInitialDivisions(divisions);
 	this->path.generate();
+	this->radii.clear();
 }
 
 int Stem::getCollarDivisions() const
@@ -222,10 +276,19 @@ int Stem::getCollarDivisions() const
 	return this->path.getInitialDivisions();
 }
 
-void Stem::setPath(Path &path)
+void Stem::setPath(const Path &path)
 {
 	this->path = path;
 	this->path.generate();
+	this->radii.clear();
+	updatePositions(this);
+}
+
+void Stem::setPath(Path &&path)
+{
+	this->path = std::move(path);
+	this->path.generate();
+	this->radii.clear();
 	updatePositions(this);
 }
 
@@ -247,7 +310,7 @@ void Stem::updatePositions(Stem *stem)
 void Stem::setDistance(float position)
 {
 	if (this->parent != nullptr) {
-		Path parentPath = this->parent->getPath();
+		const Path &parentPath = this->parent->getPath();
 		Vec3 point = parentPath.getIntermediate(position);
 		if (std::isnan(point.x))
 			this->location = point;
@@ -349,6 +412,7 @@ int Stem::getDepth() const
 void Stem::setMaxRadius(float radius)
 {
 	this->maxRadius = radius;
+	this->radii.clear();
 }
 
 float Stem::getMaxRadius() const
@@ -359,6 +423,7 @@ float Stem::getMaxRadius() const
 void Stem::setMinRadius(float radius)
 {
 	this->minRadius = radius;
+	this->radii.clear();
 }
 
 float Stem::getMinRadius() const
@@ -369,6 +434,7 @@ float Stem::getMinRadius() const
 void Stem::setRadiusCurve(unsigned index)
 {
 	this->radiusCurve = index;
+	this->radii.clear();
 }
 
 unsigned Stem::getRadiusCurve() const
@@ -386,7 +452,7 @@ Vec2 Stem::getSwelling() const
 	return this->swelling;
 }
 
-std::vector<Joint> Stem::getJoints() const
+const std::vector<Joint> &Stem::getJoints() const
 {
 	return this->joints;
 }
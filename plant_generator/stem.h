@@ -30,6 +30,8 @@
 #endif
 
 namespace pg {
+	struct StemBlock;
+
 	class Stem {
 		friend class Plant;
 		friend class StemPool;
@@ -44,6 +46,8 @@ namespace pg {
 		};
 		Stem *child;
 		Stem *parent;
+		/* The pool that the stem belongs to, which is not copied. */
+		StemBlock *pool;
 
 		std::vector<Leaf> leaves;
 		std::vector<Joint> joints;
@@ -62,9 +66,16 @@ namespace pg {
 		bool custom;
 		ParameterTree parameterTree;
 		GeneratorState state;
+		PatternState pattern;
+		/* Radii at the points of the path, which the plant computes
+		when they are first needed. Copies do not share them because
+		they can belong to a plant with other curves. */
+		std::vector<float> radii;
+		unsigned radiiRevision;
 
 		void updatePositions(Stem *stem);
 		void init(Stem *parent = nullptr);
+		void relocate(Stem &stem);
 
 #ifdef PG_SERIALIZE
 		friend class boost::serialization::access;
@@ -106,8 +117,11 @@ namespace pg {
 		void setCustom(bool custom);
 		bool isCustom() const;
 		void setParameterTree(ParameterTree parameterTree);
-		ParameterTree getParameterTree() const;
+		const ParameterTree &getParameterTree() const;
 		GeneratorState *getState();
+		const GeneratorState *getState() const;
+		PatternState *getPatternState();
+		const PatternState *getPatternState() const;
 
 		size_t addLeaf(const Leaf &leaf);
 		void insertLeaf(const Leaf &leaf, size_t index);
@@ -127,7 +141,8 @@ namespace pg {
 		int getSectionDivisions() const;
 		void setCollarDivisions(int divisions);
 		int getCollarDivisions() const;
-		void setPath(Path &path);
+		void setPath(const Path &path);
+		void setPath(Path &&path);
 		const Path &getPath() const;
 		void setSwelling(Vec2 scale);
 		Vec2 getSwelling() const;
@@ -137,7 +152,7 @@ namespace pg {
 		void setMaterial(Type feature, unsigned material);
 		unsigned getMaterial(Type feature) const;
 
-		std::vector<Joint> getJoints() const;
+		const std::vector<Joint> &getJoints() const;
 		bool hasJoints() const;
 		void addJoint(Joint joint);
 		void clearJoints();
@@ -15,12 +15,15 @@
 
 #include "stem_pool.h"
 #include <cassert>
+#include <utility>
 
 using namespace pg;
-using std::list;
-using std::array;
+using std::vector;
 
-StemPool::StemPool() : firstAvailable(nullptr), counter(0)
+StemPool::StemPool(size_t capacity) :
+	firstAvailable(nullptr),
+	counter(0),
+	capacity(capacity > 0 ? capacity : 1)
 {
 
 }
@@ -29,10 +32,10 @@ Stem *StemPool::allocate()
 {
 	Stem *stem = this->firstAvailable;
 	if (stem) {
-		auto pool = getPool(stem);
+		StemBlock *pool = getPool(stem);
 		pool->remaining--;
 	} else {
-		Pool &pool = addPool();
+		StemBlock &pool = addPool();
 		stem = this->firstAvailable;
 		pool.remaining--;
 	}
@@ -42,71 +45,93 @@ Stem *StemPool::allocate()
 	return stem;
 }
 
-StemPool::Pool &StemPool::addPool()
+StemBlock &StemPool::addPool()
 {
 	assert(!this->firstAvailable);
 
-	this->pools.push_back(Pool());
-	Pool &pool = this->pools.back();
+	this->pools.emplace_back();
+	StemBlock &pool = this->pools.back();
 	pool.id = ++this->counter;
-	pool.remaining = PG_POOL_SIZE;
+	pool.remaining = this->capacity;
+	pool.capacity = this->capacity;
+	pool.stems.reset(new Stem[pool.capacity]);
 	this->firstAvailable = &pool.stems[0];
 
 	Stem *next = this->firstAvailable;
 	Stem *prev = nullptr;
-	for (int i = 0; i < PG_POOL_SIZE-1; i++) {
+	for (size_t i = 0; i < pool.capacity; i++) {
+		pool.stems[i].pool = &pool;
 		pool.stems[i].prevAvailable = prev;
 		prev = next;
 		pool.stems[i].nextAvailable = ++next;
 	}
-	pool.stems[PG_POOL_SIZE-1].prevAvailable = prev;
-	pool.stems[PG_POOL_SIZE-1].nextAvailable = nullptr;
+	pool.stems[pool.capacity-1].nextAvailable = nullptr;
 
 	return pool;
 }
 
 size_t StemPool::deallocate(Stem *stem)
 {
-	list<Pool>::iterator it = getPool(stem);
-	it->remaining++;
-	if (this->firstAvailable) {
-		stem->prevAvailable = nullptr;
+	StemBlock *pool = getPool(stem);
+	release(stem);
+	return pool->remaining;
+}
+
+void StemPool::deallocate(const vector<Stem *> &stems)
+{
+	for (Stem *stem : stems)
+		release(stem);
+}
+
+/** Return a stem to its pool and make it the first available stem. */
+void StemPool::release(Stem *stem)
+{
+	StemBlock *pool = getPool(stem);
+	assert(pool);
+	pool->remaining++;
+	stem->prevAvailable = nullptr;
+	stem->nextAvailable = this->firstAvailable;
+	if (this->firstAvailable)
 		this->firstAvailable->prevAvailable = stem;
-		stem->nextAvailable = this->firstAvailable;
-		this->firstAvailable = stem;
-	} else {
-		this->firstAvailable = stem;
-		stem->prevAvailable = nullptr;
-		stem->nextAvailable = nullptr;
-	}
-	return it->remaining;
+	this->firstAvailable = stem;
 }
 
-list<StemPool::Pool>::iterator StemPool::getPool(Stem *stem)
+/** Each stem of a pool points to its pool, so that stems are returned
+without searching the pools. */
+StemBlock *StemPool::getPool(const Stem *stem) const
 {
-	for (auto it = this->pools.begin(); it != this->pools.end(); it++) {
-		const void *start = &it->stems[0];
-		const void *end = &it->stems[0] + PG_POOL_SIZE - 1;
-		if (start <= stem && stem <= end)
-			return it;
-	}
-	return this->pools.end();
+	return stem->pool;
 }
 
 long StemPool::getPoolID(const Stem *stem) const
 {
-	for (const auto &pool : this->pools) {
-		const void *start = &pool.stems[0];
-		const void *end = &pool.stems[0] + PG_POOL_SIZE - 1;
-		if (start <= stem && stem <= end)
-			return pool.id;
-	}
-	return 0;
+	StemBlock *pool = getPool(stem);
+	return pool ? pool->id : 0;
+}
+
+void StemPool::setPoolCapacity(size_t capacity)
+{
+	this->capacity = capacity > 0 ? capacity : 1;
 }
 
 size_t StemPool::getPoolCapacity() const
 {
-	return PG_POOL_SIZE;
+	return this->capacity;
+}
+
+StemPool::Occupancy StemPool::getOccupancy() const
+{
+	Occupancy occupancy = {};
+	occupancy.pools = this->pools.size();
+	for (const StemBlock &pool : this->pools) {
+		if (pool.remaining == pool.capacity)
+			occupancy.emptyPools++;
+		occupancy.allocated += pool.capacity - pool.remaining;
+		occupancy.capacity += pool.capacity;
+		occupancy.bytes += sizeof(StemBlock);
+		occupancy.bytes += pool.capacity * sizeof(Stem);
+	}
+	return occupancy;
 }
 
 size_t StemPool::getPoolCount() const
@@ -134,4 +159,13 @@ void StemPool::removePool(long id)
 void StemPool::clear()
 {
 	this->pools.clear();
+	this->firstAvailable = nullptr;
+}
+
+void StemPool::swap(StemPool &pool)
+{
+	std::swap(this->pools, pool.pools);
+	std::swap(this->firstAvailable, pool.firstAvailable);
+	std::swap(this->counter, pool.counter);
+	std::swap(this->capacity, pool.capacity);
 }
@@ -17,36 +17,61 @@
 #define PG_STEM_POOL_H
 
 #include "stem.h"
-#include <array>
 #include <list>
+#include <memory>
+#include <vector>
 
+/* The default number of stems in a pool. */
 #define PG_POOL_SIZE 100
 
 namespace pg {
+	/** A block of stems that is allocated at once. */
+	struct StemBlock {
+		long id;
+		size_t remaining;
+		size_t capacity;
+		std::unique_ptr<Stem[]> stems;
+	};
+
 	class StemPool {
-		struct Pool {
-			long id;
-			size_t remaining;
-			std::array<Stem, PG_POOL_SIZE> stems;
-		};
-		std::list<Pool> pools;
+		std::list<StemBlock> pools;
 		Stem *firstAvailable;
 		long counter;
+		size_t capacity;
 
-		Pool &addPool();
-		std::list<Pool>::iterator getPool(Stem *stem);
+		StemBlock &addPool();
+		StemBlock *getPool(const Stem *stem) const;
+		void release(Stem *stem);
 
 	public:
-		StemPool();
+		struct Occupancy {
+			size_t pools;
+			/** Pools without allocated stems. */
+			size_t emptyPools;
+			size_t allocated;
+			/** The number of stems in every pool. */
+			size_t capacity;
+			/** The memory of the pools. */
+			size_t bytes;
+		};
+
+		StemPool(size_t capacity = PG_POOL_SIZE);
 		StemPool(const StemPool &) = delete;
 		Stem *allocate();
 		size_t deallocate(Stem *stem);
+		/** Deallocate stems in order. */
+		void deallocate(const std::vector<Stem *> &stems);
 		long getPoolID(const Stem *stem) const;
 		size_t getRemaining(long id) const;
 		size_t getPoolCount() const;
+		/** Set the number of stems in pools that are added later. */
+		void setPoolCapacity(size_t capacity);
 		size_t getPoolCapacity() const;
+		Occupancy getOccupancy() const;
 		void removePool(long id);
 		void clear();
+		/** Exchange the pools and stems of two pools. */
+		void swap(StemPool &pool);
 	};
 }
 
@@ -0,0 +1,108 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "variant_generator.h"
+#include "file/wavefront.h"
+#include "parallel.h"
+#include <atomic>
+
+using namespace pg;
+
+VariantGenerator::Context::Context() :
+	pattern(&this->plant),
+	mesh(&this->plant)
+{
+	this->plant.setDefault();
+}
+
+VariantGenerator::VariantGenerator(ParameterTree parameterTree) :
+	threads(1),
+	parameterTree(parameterTree)
+{
+
+}
+
+void VariantGenerator::setThreads(int threads)
+{
+	this->threads = threads;
+}
+
+int VariantGenerator::getThreads() const
+{
+	return this->threads;
+}
+
+void VariantGenerator::addSeed(int seed)
+{
+	/* The nodes are only copied if the seed is different. */
+	const ParameterTree &original = this->parameterTree;
+	const ParameterNode *root = original.getRoot();
+	ParameterTree parameterTree = original;
+	if (root && root->getData().seed != seed) {
+		StemData data = root->getData();
+		data.seed = seed;
+		parameterTree.getRoot()->setData(data);
+	}
+	this->variants.push_back(parameterTree);
+}
+
+void VariantGenerator::addVariant(ParameterTree parameterTree)
+{
+	this->variants.push_back(parameterTree);
+}
+
+size_t VariantGenerator::getVariantCount() const
+{
+	return this->variants.size();
+}
+
+std::vector<VariantGenerator::Variant> VariantGenerator::generate()
+{
+	std::vector<Variant> variants(this->variants.size());
+	generate([&](size_t index, const Mesh &mesh, const Plant &) {
+		mesh.copyVertices(variants[index].vertices);
+		mesh.copyIndices(variants[index].indices);
+	});
+	return variants;
+}
+
+void VariantGenerator::exportFiles(std::string prefix)
+{
+	generate([&](size_t index, const Mesh &mesh, const Plant &plant) {
+		Wavefront wavefront;
+		std::string filename = prefix + std::to_string(index) + ".obj";
+		wavefront.exportFile(filename, mesh, plant);
+	});
+}
+
+/** Variants are handed out one at a time to threads that each grow them
+with their own context. */
+void VariantGenerator::generate(
+	std::function<void(size_t, const Mesh &, const Plant &)> function)
+{
+	size_t count = this->variants.size();
+	std::atomic<size_t> next(0);
+	size_t threads = this->threads < 1 ? 1 : this->threads;
+	if (threads > count)
+		threads = count;
+	parallelFor(threads, threads, [&](size_t) {
+		Context context;
+		for (size_t i = next++; i < count; i = next++) {
+			context.pattern.setParameterTree(this->variants[i]);
+			context.pattern.grow();
+			function(i, context.mesh.generate(), context.plant);
+		}
+	});
+}
@@ -0,0 +1,72 @@
+/* Copyright 2022 Floris Creyf
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PG_VARIANT_GENERATOR_H
+#define PG_VARIANT_GENERATOR_H
+
+#include "mesh/generator.h"
+#include "parameter_tree.h"
+#include "pattern_generator.h"
+#include "plant.h"
+#include "vertex.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace pg {
+	/** Grows and meshes variants of a parameter tree in parallel. Each
+	thread reuses one plant and mesh generator for the variants that it
+	grows, so the stems and vertex buffers are only allocated once per
+	thread. */
+	class VariantGenerator {
+	public:
+		struct Variant {
+			std::vector<DVertex> vertices;
+			std::vector<unsigned> indices;
+		};
+
+		VariantGenerator(ParameterTree parameterTree);
+		void setThreads(int threads);
+		int getThreads() const;
+		/** Add a variant that only differs in the seed of the root. */
+		void addSeed(int seed);
+		/** Add a variant with different parameters. */
+		void addVariant(ParameterTree parameterTree);
+		size_t getVariantCount() const;
+		/** Grow and mesh every variant. The meshes are in the order
+		that the variants were added in. */
+		std::vector<Variant> generate();
+		/** Grow every variant and write it to a Wavefront file that is
+		named with the prefix and the index of the variant. */
+		void exportFiles(std::string prefix);
+
+	private:
+		struct Context {
+			Plant plant;
+			PatternGenerator pattern;
+			MeshGenerator mesh;
+			Context();
+		};
+
+		int threads;
+		ParameterTree parameterTree;
+		std::vector<ParameterTree> variants;
+
+		void generate(std::function<void(size_t, const Mesh &,
+			const Plant &)>);
+	};
+}
+
+#endif
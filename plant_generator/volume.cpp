@@ -14,6 +14,8 @@
  */
 
 #include "volume.h"
+#include <algorithm>
+#include <cmath>
 
 using pg::Ray;
 using pg::Vec3;
@@ -21,186 +23,559 @@ using pg::Volume;
 
 typedef Volume::Node Node;
 
-Volume::Volume(float size, int depth) :
+const float pi = 3.14159265359f;
+
+/* The number of nodes in each chunk of the tree layout. This has to be a
+multiple of eight so that siblings are never split between chunks. */
+const size_t nodesPerChunk = 4096;
+
+/* The linear layout keeps the deepest node that contains each cell down to
+this depth, which takes four bytes for each of the 8^depth cells. Nodes that
+are deeper are found by following children from there. */
+const int maxIndexDepth = 6;
+
+/* Voxels that might overlap a capsule are tested in batches so that the
+distance computations can be vectorized. */
+const int capsuleBatch = 64;
+
+/* The number of points along each axis of a voxel that are tested to
+estimate how much of the voxel a capsule covers. */
+const int coverageSamples = 4;
+
+/* Half of the diagonal of a voxel with a width of one. */
+const float halfDiagonal = 0.8660254f;
+
+/* A tapered capsule in the coordinates of the cells at some depth. */
+struct Capsule {
+	float a[3];
+	float b[3];
+	float radiusA;
+	float radiusB;
+	/* The axis, the inverse of its squared length and the change of the
+	radius along the axis. */
+	float d[3];
+	float inverse;
+	float taper;
+};
+
+/* Spread the first 21 bits of a number so that there are two zero bits
+between each bit. */
+uint64_t spread(uint64_t x)
+{
+	x &= 0x1fffff;
+	x = (x | x << 32) & 0x1f00000000ffff;
+	x = (x | x << 16) & 0x1f0000ff0000ff;
+	x = (x | x << 8) & 0x100f00f00f00f00f;
+	x = (x | x << 4) & 0x10c30c30c30c30c3;
+	x = (x | x << 2) & 0x1249249249249249;
+	return x;
+}
+
+Volume::Volume(float size, int depth, Layout layout) :
 	size(size),
 	depth(depth),
-	root(Vec3(0.0f, 0.0f, size*0.5f), 0.5f*size)
+	layout(layout),
+	root(Vec3(0.0f, 0.0f, size*0.5f), 0.5f*size),
+	used(0),
+	peakNodes(0),
+	peakBytes(0),
+	concurrent(false)
 {
-
+	clear(size, depth);
 }
 
 void Volume::clear(float size, int depth)
 {
+	this->used = 0;
+	this->spare.clear();
+	this->nodes.clear();
+	this->levels.clear();
 	this->size = size;
 	this->depth = depth;
 	this->root = Node(Vec3(0.0f, 0.0f, size*0.5f), 0.5f*size);
-	if (this->root.getNode(0))
-		this->root.clear();
+	this->indexDepth = std::min(std::max(depth, 0), maxIndexDepth);
+	if (this->layout == Linear)
+		this->index.assign((size_t)1 << 3*this->indexDepth, 0);
+	else
+		this->index.clear();
+}
+
+void Volume::clearFlux()
+{
+	clearFlux(&this->root);
+}
+
+void Volume::clearFlux(Node *node)
+{
+	node->direction = Vec3(0.0f, 0.0f, 0.0f);
+	node->quantity = 0;
+	if (node->nodes)
+		for (int i = 0; i < 8; i++)
+			clearFlux(node->getNode(i));
+}
+
+void Volume::setLayout(Layout layout)
+{
+	this->layout = layout;
+	clear(this->size, this->depth);
+}
+
+Volume::Layout Volume::getLayout() const
+{
+	return this->layout;
+}
+
+void Volume::setConcurrent(bool concurrent)
+{
+	this->concurrent = concurrent;
+}
+
+bool Volume::isConcurrent() const
+{
+	return this->concurrent;
+}
+
+/** Lock the volume if nodes are added to the linear layout from several
+threads. */
+std::unique_lock<std::mutex> Volume::lockLinear()
+{
+	if (this->concurrent && this->layout == Linear)
+		return std::unique_lock<std::mutex>(this->mutex);
+	return std::unique_lock<std::mutex>();
+}
+
+int Volume::getDepth() const
+{
+	return this->depth;
+}
+
+std::vector<Node *> Volume::getDividedNodes(int depth)
+{
+	std::vector<Node *> nodes;
+	if (depth < (int)this->levels.size()) {
+		nodes.reserve(this->levels[depth].size());
+		for (size_t first : this->levels[depth])
+			nodes.push_back(this->nodes[first].parent);
+	}
+	return nodes;
+}
+
+void Volume::reserve(size_t size)
+{
+	if (this->layout == Tree) {
+		while (this->chunks.size() * nodesPerChunk < size)
+			this->chunks.emplace_back(new Node[nodesPerChunk]);
+		updateStatistics();
+		return;
+	}
+	if (size <= this->nodes.capacity())
+		return;
+
+	/* Grow the linear layout and update the pointers between nodes. */
+	std::vector<Node> nodes;
+	nodes.reserve(std::max(size, 2 * this->nodes.capacity()));
+	nodes.insert(nodes.end(), this->nodes.begin(), this->nodes.end());
+	Node *base = this->nodes.data();
+	if (this->root.nodes)
+		this->root.nodes = nodes.data() + (this->root.nodes - base);
+	for (Node &node : nodes) {
+		Node *children = node.nodes;
+		if (children)
+			node.nodes = nodes.data() + (children - base);
+		if (node.parent != &this->root)
+			node.parent = nodes.data() + (node.parent - base);
+	}
+	this->nodes.swap(nodes);
+	updateStatistics();
+}
+
+Volume::Statistics Volume::getStatistics() const
+{
+	Statistics statistics;
+	if (this->layout == Tree)
+		statistics.nodes = this->used;
+	else
+		statistics.nodes = this->nodes.size();
+	statistics.peakNodes = this->peakNodes;
+	statistics.bytes = this->chunks.size() * nodesPerChunk * sizeof(Node);
+	statistics.bytes += this->nodes.capacity() * sizeof(Node);
+	statistics.peakBytes = this->peakBytes;
+	return statistics;
+}
+
+void Volume::updateStatistics()
+{
+	Statistics statistics = getStatistics();
+	this->peakNodes = std::max(this->peakNodes, statistics.nodes);
+	this->peakBytes = std::max(this->peakBytes, statistics.bytes);
 }
 
 Node *Volume::addNode(Vec3 point, int depth)
 {
-	Node *node = getNode(point, &this->root);
-	while (node->getDepth() < this->depth && node->getDepth() < depth) {
-		node->divide();
-		node = getNode(point, node);
+	std::unique_lock<std::mutex> lock = lockLinear();
+	return addNode(getCode(point), depth, true);
+}
+
+/** Divide nodes down to a depth. The new children either start without
+density or inherit the density of their parent. */
+Node *Volume::addNode(uint64_t code, int depth, bool inherit)
+{
+	Node *node = getNode(code, this->depth);
+	while (node->depth < this->depth && node->depth < depth) {
+		node = divide(node, inherit);
+		int shift = 3 * (this->depth - node->depth - 1);
+		node = node->getNode((code >> shift) & 7);
 	}
 	return node;
 }
 
 void Volume::addLine(Vec3 a, Vec3 b, float weight, float radius)
 {
-	float length = magnitude(b-a);
+	std::unique_lock<std::mutex> lock = lockLinear();
 	int depth = std::abs(std::log2(radius/this->size))-1;
-	Node *firstNode = addNode(a, depth);
-	Node *lastNode = addNode(b, depth);
-	a = firstNode->getCenter();
-	b = lastNode->getCenter();
-	Ray ray(a, normalize(b-a));
-	Node *node = firstNode;
-	node->setDensity(weight);
-
-	while (node != lastNode) {
-		Node *nextNode = node->getAdjacentNode(ray, depth);
-		if (!nextNode || nextNode == node)
-			break;
-
-		Vec3 center = node->getCenter();
-		node = nextNode;
-		if (magnitude(a-center) > length)
-			break;
-
-		int d = node->getDepth();
-		while (d < this->depth && d < depth) {
-			node->divide();
-			node = node->getChildNode(center, depth);
-			d = node->getDepth();
-		}
-		node->setDensity(weight);
+	depth = std::min(std::max(depth, 0), this->depth);
+	float length = magnitude(b-a);
+	if (length == 0.0f) {
+		addDensity(getCode(a), depth, weight);
+		return;
+	}
+
+	/* The traversal can pass through several leaves of a node that was
+	divided by a thinner line. The node is only raised once since a line
+	does not enter a node again after leaving it. */
+	uint64_t key = 0;
+	Traversal traversal(this, Ray(a, (b-a)/length), length);
+	Node *node = traversal.next(depth);
+	while (node) {
+		while (node->depth > depth)
+			node = node->parent;
+		if (node->key != key)
+			addDensity(node, weight);
+		key = node->key;
+		node = traversal.next(depth);
 	}
 }
 
-Node *Node::getAdjacentNode(Ray ray, int depth)
+/* Compute the distance from the centers of cells to the surface of a
+capsule, which is negative inside, and the distance from the capsule to the
+planes through the cells that face the capsule. A cell whose plane is not
+closer than zero does not touch the capsule. The capsule is copied into
+locals because the stores could otherwise alias it. The loop is only
+vectorized if this file is compiled without math errno and trapping math. */
+void getDistances(const Capsule &capsule, const float *x, const float *y,
+	const float *z, float *distances, float *gaps, int count)
 {
-	Vec3 d;
-	Plane plane;
-	plane.point = this->center;
-	if (ray.direction.x < 0.0f) {
-		plane.point.x -= this->size;
-		d.x = -1.0f;
-	} else {
-		plane.point.x += this->size;
-		d.x = 1.0f;
+	const float ax = capsule.a[0];
+	const float ay = capsule.a[1];
+	const float az = capsule.a[2];
+	const float dx = capsule.d[0];
+	const float dy = capsule.d[1];
+	const float dz = capsule.d[2];
+	const float inverse = capsule.inverse;
+	const float radiusA = capsule.radiusA;
+	const float taper = capsule.taper;
+	const float maxRadius = std::max(capsule.radiusA, capsule.radiusB);
+	for (int i = 0; i < count; i++) {
+		float px = x[i] - ax;
+		float py = y[i] - ay;
+		float pz = z[i] - az;
+		float t = (px*dx + py*dy + pz*dz) * inverse;
+		t = std::min(std::max(t, 0.0f), 1.0f);
+		px -= t * dx;
+		py -= t * dy;
+		pz -= t * dz;
+		float radius = radiusA + t * taper;
+		float distance = std::sqrt(px*px + py*py + pz*pz);
+		float extent = std::abs(px) + std::abs(py) + std::abs(pz);
+		extent *= 0.5f / std::max(distance, 1e-6f);
+		distances[i] = distance - radius;
+		gaps[i] = distance - maxRadius - extent;
 	}
-	if (ray.direction.y < 0.0f) {
-		plane.point.y -= this->size;
-		d.y = -1.0f;
-	} else {
-		plane.point.y += this->size;
-		d.y = 1.0f;
+}
+
+/* Estimate the volume of a capsule inside a cell from the length of its
+axis inside the cell. This is used when the capsule is too thin for any
+sample point to be inside it. */
+float getThinCoverage(const Capsule &capsule, const float center[3])
+{
+	float t0 = 0.0f;
+	float t1 = 1.0f;
+	for (int i = 0; i < 3; i++) {
+		float lower = center[i] - 0.5f - capsule.a[i];
+		float upper = center[i] + 0.5f - capsule.a[i];
+		if (capsule.d[i] != 0.0f) {
+			float s0 = lower / capsule.d[i];
+			float s1 = upper / capsule.d[i];
+			t0 = std::max(t0, std::min(s0, s1));
+			t1 = std::min(t1, std::max(s0, s1));
+		} else if (lower > 0.0f || upper <= 0.0f)
+			return 0.0f;
 	}
-	if (ray.direction.z < 0.0f) {
-		plane.point.z -= this->size;
-		d.z = -1.0f;
-	} else {
-		plane.point.z += this->size;
-		d.z = 1.0f;
+	if (t1 < t0)
+		return 0.0f;
+
+	float t = 0.5f * (t0 + t1);
+	float radius = capsule.radiusA + t * capsule.taper;
+	float volume = 4.0f / 3.0f * pi * radius * radius * radius;
+	if (capsule.inverse > 0.0f) {
+		float length = (t1 - t0) / std::sqrt(capsule.inverse);
+		volume = pi * radius * radius * length;
 	}
+	return std::min(volume, 1.0f);
+}
 
-	Node *node = this;
-	Vec3 p;
-	float t;
-
-	plane.normal = Vec3(d.x, 0.0f, 0.0f);
-	t = intersectsPlane(ray, plane);
-	p = t*ray.direction + ray.origin;
-	p.y -= 0.000001f;
-	p.z -= 0.000001f;
-	if (t && d.y*p.y < d.y*plane.point.y && d.z*p.z < d.z*plane.point.z)
-		node = node->getAdjacentNode(1, p, d.x > 0.0f, depth);
-
-	plane.normal = Vec3(0.0f, d.y, 0.0f);
-	t = intersectsPlane(ray, plane);
-	p = t*ray.direction + ray.origin;
-	p.x -= 0.000001f;
-	p.z -= 0.000001f;
-	if (t && d.x*p.x < d.x*plane.point.x && d.z*p.z < d.z*plane.point.z)
-		node = node->getAdjacentNode(2, p, d.y > 0.0f, depth);
-
-	plane.normal = Vec3(0.0f, 0.0f, d.z);
-	t = intersectsPlane(ray, plane);
-	p = t*ray.direction + ray.origin;
-	p.y -= 0.000001f;
-	p.x -= 0.000001f;
-	if (t && d.y*p.y < d.y*plane.point.y && d.x*p.x < d.x*plane.point.x)
-		node = node->getAdjacentNode(4, p, d.z > 0.0f, depth);
+/* Offsets of the sample points from the center of a cell. */
+struct Samples {
+	static const int count =
+		coverageSamples * coverageSamples * coverageSamples;
+	float offsets[3][count];
+
+	Samples()
+	{
+		const int n = coverageSamples;
+		for (int i = 0; i < count; i++) {
+			int index[3] = {i % n, i / n % n, i / n / n};
+			for (int j = 0; j < 3; j++)
+				offsets[j][i] = (index[j] + 0.5f) / n - 0.5f;
+		}
+	}
+};
 
-	return node;
+/* Return the fraction of a cell that is inside a capsule. Each sample
+point counts in proportion to how far it is inside the capsule relative to
+the spacing of the points, which is more accurate than counting points that
+are inside. */
+float getCoverage(const Capsule &capsule, const float center[3])
+{
+	static const Samples samples;
+	const int count = Samples::count;
+	if (std::max(capsule.radiusA, capsule.radiusB) < 0.5f/coverageSamples)
+		return getThinCoverage(capsule, center);
+
+	const float *d = capsule.d;
+	float p[3];
+	for (int i = 0; i < 3; i++)
+		p[i] = center[i] - capsule.a[i];
+	float inside = 0.0f;
+	for (int i = 0; i < count; i++) {
+		float px = p[0] + samples.offsets[0][i];
+		float py = p[1] + samples.offsets[1][i];
+		float pz = p[2] + samples.offsets[2][i];
+		float t = (px*d[0] + py*d[1] + pz*d[2]) * capsule.inverse;
+		t = std::min(std::max(t, 0.0f), 1.0f);
+		px -= t * d[0];
+		py -= t * d[1];
+		pz -= t * d[2];
+		float radius = capsule.radiusA + t * capsule.taper;
+		float distance = std::sqrt(px*px + py*py + pz*pz) - radius;
+		float weight = 0.5f - distance * coverageSamples;
+		inside += std::min(std::max(weight, 0.0f), 1.0f);
+	}
+	if (inside == 0.0f)
+		return getThinCoverage(capsule, center);
+	return inside / count;
 }
 
-Node *Node::getAdjacentNode(int axis, Vec3 point, bool positive, int depth)
+void Volume::addCapsule(Vec3 a, Vec3 b, float radiusA, float radiusB,
+	float weight)
 {
-	if (!getParent())
-		return this;
-	else if (positive)
-		return getNextNode(axis, point, depth);
-	else
-		return getPreviousNode(axis, point, depth);
+	std::unique_lock<std::mutex> lock = lockLinear();
+	float radius = std::max(radiusA, radiusB);
+	int depth = std::abs(std::log2(radius/this->size))-1;
+	depth = std::min(std::max(depth, 0), this->depth);
+	const int64_t cells = (int64_t)1 << depth;
+	const float width = 2.0f * this->root.size / cells;
+	a = (a - this->root.center + Vec3(this->root.size)) / width;
+	b = (b - this->root.center + Vec3(this->root.size)) / width;
+	Capsule capsule = {
+		{a.x, a.y, a.z}, {b.x, b.y, b.z},
+		radiusA / width, radiusB / width,
+		{b.x - a.x, b.y - a.y, b.z - a.z}, 0.0f,
+		(radiusB - radiusA) / width};
+	const float *d = capsule.d;
+	float dd = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+	capsule.inverse = dd > 0.0f ? 1.0f / dd : 0.0f;
+	radius /= width;
+
+	/* Cells are visited in slabs along the axis in which the segment is
+	longest. Only the cells near the part of the segment in the slab are
+	candidates. */
+	int axis = 0;
+	for (int i = 1; i < 3; i++)
+		if (std::abs(d[i]) > std::abs(d[axis]))
+			axis = i;
+	const int u = (axis + 1) % 3;
+	const int v = (axis + 2) % 3;
+	auto getCell = [&](float x) {
+		int64_t cell = std::floor(x);
+		return std::min(std::max(cell, (int64_t)0), cells - 1);
+	};
+
+	float x[capsuleBatch];
+	float y[capsuleBatch];
+	float z[capsuleBatch];
+	float distances[capsuleBatch];
+	float gaps[capsuleBatch];
+	uint64_t codes[capsuleBatch];
+	int count = 0;
+	auto addCandidates = [&]() {
+		getDistances(capsule, x, y, z, distances, gaps, count);
+		for (int i = 0; i < count; i++) {
+			if (gaps[i] >= 0.0f)
+				continue;
+			float center[3] = {x[i], y[i], z[i]};
+			float coverage = 1.0f;
+			if (distances[i] > -halfDiagonal)
+				coverage = getCoverage(capsule, center);
+			if (coverage > 0.0f)
+				addDensity(codes[i], depth, weight * coverage);
+		}
+		count = 0;
+	};
+
+	float lower = std::min(capsule.a[axis], capsule.b[axis]) - radius;
+	float upper = std::max(capsule.a[axis], capsule.b[axis]) + radius;
+	for (int64_t i = getCell(lower); i <= getCell(upper); i++) {
+		float t0 = 0.0f;
+		float t1 = 1.0f;
+		if (d[axis] != 0.0f) {
+			float s0 = (i - radius - capsule.a[axis]) / d[axis];
+			float s1 = (i + 1 + radius - capsule.a[axis]) / d[axis];
+			t0 = std::max(t0, std::min(s0, s1));
+			t1 = std::min(t1, std::max(s0, s1));
+		}
+		if (t1 < t0)
+			continue;
+
+		int64_t range[2][2];
+		const int axes[2] = {u, v};
+		for (int j = 0; j < 2; j++) {
+			float p0 = capsule.a[axes[j]] + t0 * d[axes[j]];
+			float p1 = capsule.a[axes[j]] + t1 * d[axes[j]];
+			range[j][0] = getCell(std::min(p0, p1) - radius);
+			range[j][1] = getCell(std::max(p0, p1) + radius);
+		}
+		for (int64_t j = range[0][0]; j <= range[0][1]; j++) {
+			for (int64_t k = range[1][0]; k <= range[1][1]; k++) {
+				float center[3];
+				int64_t cell[3];
+				cell[axis] = i;
+				cell[u] = j;
+				cell[v] = k;
+				codes[count] = 0;
+				for (int l = 0; l < 3; l++) {
+					center[l] = cell[l] + 0.5f;
+					int shift = this->depth - depth;
+					uint64_t c = cell[l] << shift;
+					codes[count] |= spread(c) << l;
+				}
+				x[count] = center[0];
+				y[count] = center[1];
+				z[count] = center[2];
+				if (++count == capsuleBatch)
+					addCandidates();
+			}
+		}
+	}
+	addCandidates();
 }
 
-Node *Node::getNextNode(int axis, Vec3 point, int depth)
+/** Add density to the node at a depth that contains a cell of the maximum
+depth. Leaves below the node receive the same density, and density is never
+reduced. */
+void Volume::addDensity(uint64_t code, int depth, float density)
 {
-	Node *node = this;
-	Node *pnode = node->getParent();
-	if (!pnode)
-		return nullptr;
-	/* A set bit is in the positive direction, and an unset bit is in the
-	negative direction (x=1, y=2, z=4). */
-	int index = node - pnode->getNode(0);
-	if ((index & axis) == axis)
-		node = pnode->getNextNode(axis, point, depth);
-	else
-		node = pnode->getNode(index + axis);
+	Node *node = addNode(code, depth, true);
+	while (node->depth > depth)
+		node = node->parent;
+	addDensity(node, density);
+}
 
-	if (node && node->getNode(0) && node->depth < depth)
-		node = node->getChildNode(point, depth);
-	return node ? node : this;
+void Volume::addDensity(Node *node, float density)
+{
+	float current = node->density;
+	while (current < density &&
+		!node->density.compare_exchange_weak(current, density));
+	Node *nodes = node->nodes.load(std::memory_order_seq_cst);
+	if (nodes)
+		for (int i = 0; i < 8; i++)
+			addDensity(&nodes[i], density);
 }
 
-Node *Node::getPreviousNode(int axis, Vec3 point, int depth)
+Volume::Traversal::Traversal(Volume *volume, Ray ray, float length) :
+	volume(volume),
+	done(false)
 {
-	Node *node = this;
-	Node *pnode = node->getParent();
-	if (!pnode)
-		return nullptr;
-	int index = node - pnode->getNode(0);
-	if ((index & axis) == 0)
-		node = pnode->getPreviousNode(axis, point, depth);
-	else
-		node = pnode->getNode(index - axis);
-	if (node && node->getNode(0) && node->depth < depth)
-		node = node->getChildNode(point, depth);
-	return node ? node : this;
+	const Node &root = volume->root;
+	const int64_t cells = (int64_t)1 << volume->depth;
+	float width = 2.0f * root.size / cells;
+	Vec3 a = (ray.origin - root.center + Vec3(root.size)) / width;
+	this->origin[0] = a.x;
+	this->origin[1] = a.y;
+	this->origin[2] = a.z;
+	this->direction[0] = ray.direction.x;
+	this->direction[1] = ray.direction.y;
+	this->direction[2] = ray.direction.z;
+	this->length = length / width;
+	for (int i = 0; i < 3; i++) {
+		this->inverse[i] = 1.0f / this->direction[i];
+		int64_t c = std::floor(this->origin[i]);
+		this->cell[i] = std::min(std::max(c, (int64_t)0), cells - 1);
+	}
 }
 
-Node *Node::getChildNode(Vec3 point, int depth)
+Node *Volume::Traversal::next(int depth)
 {
-	Node *pnode = this;
-	Node *node = nullptr;
-	float t = std::numeric_limits<float>::max();
-	for (int i = 0; i < 8; i++) {
-		Node *cnode = pnode->getNode(i);
-		Vec3 d = cnode->getCenter() - point;
-		float m = d.x*d.x + d.y*d.y + d.z*d.z;
-		if (m < t) {
-			t = m;
-			node = cnode;
-		}
+	if (this->done)
+		return nullptr;
+
+	const int64_t cells = (int64_t)1 << this->volume->depth;
+	uint64_t code = 0;
+	for (int i = 0; i < 3; i++)
+		code |= spread(this->cell[i]) << i;
+	Node *node = this->volume->getNode(code, this->volume->depth);
+	if (node->depth < depth)
+		node = this->volume->addNode(code, depth, true);
+
+	/* Find where the ray leaves the node. */
+	int shift = this->volume->depth - node->depth;
+	int64_t lower[3];
+	int64_t upper[3];
+	float t[3];
+	float exit = std::numeric_limits<float>::max();
+	for (int i = 0; i < 3; i++) {
+		lower[i] = this->cell[i] >> shift << shift;
+		upper[i] = lower[i] + ((int64_t)1 << shift);
+		if (this->direction[i] > 0.0f)
+			t[i] = (upper[i] - this->origin[i]) * this->inverse[i];
+		else if (this->direction[i] < 0.0f)
+			t[i] = (lower[i] - this->origin[i]) * this->inverse[i];
+		else
+			t[i] = std::numeric_limits<float>::max();
+		exit = std::min(exit, t[i]);
 	}
-	if (node->getNode(0) && node->depth < depth)
-		return node->getChildNode(point, depth);
-	else
+	if (exit >= this->length) {
+		this->done = true;
 		return node;
+	}
+
+	/* The coordinates of the exit axes are stepped exactly, and the other
+	coordinates are kept inside the node so that the traversal cannot move
+	backwards due to rounding errors. */
+	for (int i = 0; i < 3; i++) {
+		int64_t c;
+		if (t[i] == exit)
+			c = this->direction[i] > 0.0f ? upper[i] : lower[i] - 1;
+		else {
+			float x = this->origin[i] + exit * this->direction[i];
+			c = std::floor(x);
+			c = std::min(std::max(c, lower[i]), upper[i] - 1);
+		}
+		if (c < 0 || c >= cells)
+			this->done = true;
+		this->cell[i] = c;
+	}
+	return node;
 }
 
 Node *Volume::getRoot()
@@ -215,26 +590,171 @@ const Node *Volume::getRoot() const
 
 Node *Volume::getNode(Vec3 point)
 {
-	return getNode(point, &this->root);
+	return getNode(getCode(point), this->depth);
+}
+
+/** Return the Morton code of the cell at the maximum depth that contains
+the point. */
+uint64_t getCoordinate(float x, float width, uint64_t cells)
+{
+	x = std::floor(x / width);
+	if (x < 0.0f)
+		return 0;
+	else if (x >= cells)
+		return cells - 1;
+	else
+		return x;
+}
+
+uint64_t Volume::getCode(Vec3 point) const
+{
+	const uint64_t cells = (uint64_t)1 << this->depth;
+	float width = 2.0f * this->root.size / cells;
+	Vec3 a = point - this->root.center + Vec3(this->root.size);
+	uint64_t x = getCoordinate(a.x, width, cells);
+	uint64_t y = getCoordinate(a.y, width, cells);
+	uint64_t z = getCoordinate(a.z, width, cells);
+	return spread(x) | spread(y) << 1 | spread(z) << 2;
 }
 
-Node *Volume::getNode(Vec3 point, Node *node)
+/** Return the deepest node that contains a cell at the given depth. The
+linear layout starts from the node in its index, which is moved up if the cell
+is larger than a cell of the index. */
+Node *Volume::getNode(uint64_t code, int depth)
 {
-	Node *n = node;
-	while (n) {
-		Vec3 a = point - node->getCenter();
-		int x = a.x >= 0.0f ? 1 : 0;
-		int y = a.y >= 0.0f ? 1 : 0;
-		int z = a.z >= 0.0f ? 1 : 0;
-		n = node->getNode(x + 2*y + 4*z);
-		node = n ? n : node;
+	Node *node = &this->root;
+	if (this->layout == Linear) {
+		uint32_t i;
+		if (depth >= this->indexDepth)
+			i = this->index[code >> 3*(depth - this->indexDepth)];
+		else
+			i = this->index[code << 3*(this->indexDepth - depth)];
+		if (i > 0)
+			node = &this->nodes[i - 1];
+		while (node->depth > depth)
+			node = node->parent;
+	}
+
+	Node *nodes = node->nodes.load(std::memory_order_acquire);
+	while (nodes && node->depth < depth) {
+		int shift = 3 * (depth - node->depth - 1);
+		node = &nodes[(code >> shift) & 7];
+		nodes = node->nodes.load(std::memory_order_acquire);
+	}
+	return node;
+}
+
+/** Find the neighbor of a node by stepping the coordinate of its Morton code
+along an axis. Carries and borrows pass through the unused bits of the other
+axes. */
+Node *Volume::getAdjacentNode(const Node *node, int axis, bool positive)
+{
+	const int depth = node->depth;
+	if (depth == 0)
+		return nullptr;
+	const uint64_t cells = ((uint64_t)1 << 3*depth) - 1;
+	const uint64_t mask = (0x1249249249249249 << axis) & cells;
+	uint64_t code = node->key & cells;
+	uint64_t bits = code & mask;
+	if (positive && bits == mask)
+		return nullptr;
+	else if (positive)
+		bits = ((bits | ~mask) + 1) & mask;
+	else if (bits == 0)
+		return nullptr;
+	else
+		bits = (bits - 1) & mask;
+	return getNode((code & ~mask) | bits, depth);
+}
+
+/** Divide a node and return its new address. Children inherit the density
+of the node when lines and capsules are added, so that the density of a leaf
+is the same in whichever order lines and capsules were added. */
+Node *Volume::divide(Node *node, bool inherit)
+{
+	float density = inherit ? node->getDensity() : 0.0f;
+	if (this->layout == Tree && !this->concurrent) {
+		node->divide(allocate(), density);
+		updateStatistics();
+		return node;
+	} else if (this->layout == Tree) {
+		if (node->nodes)
+			return node;
+		Node *nodes;
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			nodes = allocate();
+			updateStatistics();
+		}
+		/* The children are initialized before they are published, and
+		only one thread can publish children. Density that was added to
+		the node in the meantime did not reach the children. The node
+		is read again after publishing, while addDensity raises the
+		node before reading its children. Both sides need sequential
+		consistency so that at least one of them sees the other. */
+		node->initialize(nodes, density);
+		Node *expected = nullptr;
+		if (node->nodes.compare_exchange_strong(expected, nodes)) {
+			if (inherit)
+				density = node->density.load(
+					std::memory_order_seq_cst);
+			for (int i = 0; i < 8 && density > 0.0f; i++)
+				addDensity(&nodes[i], density);
+		} else {
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->spare.push_back(nodes);
+		}
+		return node;
 	}
+
+	size_t index = node - this->nodes.data();
+	bool isRoot = node == &this->root;
+	reserve(this->nodes.size() + 8);
+	if (!isRoot)
+		node = &this->nodes[index];
+	size_t first = this->nodes.size();
+	this->nodes.insert(this->nodes.end(), 8, Node());
+	if ((int)this->levels.size() <= node->depth)
+		this->levels.resize(node->depth + 1);
+	this->levels[node->depth].push_back(first);
+	node->divide(&this->nodes[first], density);
+
+	/* The cells of a node are consecutive in Morton order. */
+	int depth = node->depth + 1;
+	if (depth <= this->indexDepth) {
+		int shift = 3 * (this->indexDepth - depth);
+		uint64_t cells = (uint64_t)1 << 3*depth;
+		for (int i = 0; i < 8; i++) {
+			uint64_t code = this->nodes[first + i].key ^ cells;
+			std::fill(this->index.begin() + (code << shift),
+				this->index.begin() + ((code + 1) << shift),
+				(uint32_t)(first + i + 1));
+		}
+	}
+	updateStatistics();
 	return node;
 }
 
+/** Return eight unused nodes from the tree layout's chunks. */
+Node *Volume::allocate()
+{
+	if (!this->spare.empty()) {
+		Node *nodes = this->spare.back();
+		this->spare.pop_back();
+		return nodes;
+	}
+	size_t chunk = this->used / nodesPerChunk;
+	size_t offset = this->used % nodesPerChunk;
+	if (chunk == this->chunks.size())
+		this->chunks.emplace_back(new Node[nodesPerChunk]);
+	this->used += 8;
+	return &this->chunks[chunk][offset];
+}
+
 Node::Node(Vec3 center, float size) :
 	nodes(nullptr),
 	parent(nullptr),
+	key(1),
 	depth(0),
 	center(center),
 	size(size),
@@ -248,6 +768,7 @@ Node::Node(Vec3 center, float size) :
 Node::Node() :
 	nodes(nullptr),
 	parent(nullptr),
+	key(0),
 	depth(0),
 	density(0.0f),
 	direction(0.0f, 0.0f, 0.0f),
@@ -256,21 +777,32 @@ Node::Node() :
 
 }
 
-Node::~Node()
+Node::Node(const Node &node) :
+	nodes(node.nodes.load()),
+	parent(node.parent),
+	key(node.key),
+	depth(node.depth),
+	center(node.center),
+	size(node.size),
+	density(node.density.load()),
+	direction(node.direction),
+	quantity(node.quantity)
 {
-	if (this->nodes)
-		delete[] this->nodes;
+
 }
 
-void Node::clear()
+Node &Node::operator=(const Node &node)
 {
-	this->density = 0.0f;
-	this->direction = Vec3(0.0f, 0.0f, 0.0f);
-	this->quantity = 0;
-	if (this->nodes) {
-		delete[] this->nodes;
-		this->nodes = nullptr;
-	}
+	this->nodes = node.nodes.load();
+	this->parent = node.parent;
+	this->key = node.key;
+	this->depth = node.depth;
+	this->center = node.center;
+	this->size = node.size;
+	this->density = node.density.load();
+	this->direction = node.direction;
+	this->quantity = node.quantity;
+	return *this;
 }
 
 Vec3 Node::getCenter() const
@@ -295,23 +827,31 @@ Node *Node::getParent()
 
 Node *Node::getNode(int index)
 {
-	if (this->nodes)
-		return &this->nodes[index];
+	Node *nodes = this->nodes.load(std::memory_order_acquire);
+	if (nodes)
+		return &nodes[index];
 	else
 		return nullptr;
 }
 
 const Node *Node::getNode(int index) const
 {
-	if (this->nodes)
-		return &this->nodes[index];
+	const Node *nodes = this->nodes.load(std::memory_order_acquire);
+	if (nodes)
+		return &nodes[index];
 	else
 		return nullptr;
 }
 
-void Node::divide()
+void Node::divide(Node *nodes, float density)
+{
+	initialize(nodes, density);
+	this->nodes.store(nodes, std::memory_order_release);
+}
+
+/** Set up the children of a node without dividing it. */
+void Node::initialize(Node *nodes, float density)
 {
-	this->nodes = new Node[8];
 	for (int i = 0; i < 8; i++) {
 		Vec3 center = this->center;
 		float size = 0.5f * this->size;
@@ -327,22 +867,26 @@ void Node::divide()
 			center.z += size;
 		else
 			center.z -= size;
-		this->nodes[i].center = center;
-		this->nodes[i].size = size;
-		this->nodes[i].depth = this->depth + 1;
-		this->nodes[i].parent = this;
-		this->nodes[i].nodes = nullptr;
+		nodes[i].center = center;
+		nodes[i].size = size;
+		nodes[i].depth = this->depth + 1;
+		nodes[i].key = this->key << 3 | i;
+		nodes[i].density.store(density, std::memory_order_relaxed);
+		nodes[i].direction = Vec3(0.0f, 0.0f, 0.0f);
+		nodes[i].quantity = 0;
+		nodes[i].parent = this;
+		nodes[i].nodes.store(nullptr, std::memory_order_relaxed);
 	}
 }
 
 void Node::setDensity(float density)
 {
-	this->density = density;
+	this->density.store(density, std::memory_order_relaxed);
 }
 
 float Node::getDensity() const
 {
-	return this->density;
+	return this->density.load(std::memory_order_relaxed);
 }
 
 void Node::setDirection(Vec3 direction)
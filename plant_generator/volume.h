@@ -18,39 +18,66 @@
 
 #include "math/intersection.h"
 #include "math/vec3.h"
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef PG_SERIALIZE
+#include <boost/archive/text_oarchive.hpp>
+#endif
 
 namespace pg {
 	class Volume {
 	public:
+		/** The tree layout allocates the children of each node
+		separately. The linear layout stores every node in one array and
+		finds nodes with Morton codes instead of following pointers. An
+		index of the cells down to a depth of six finds the leaf at a
+		point with one lookup. Node pointers are invalidated when the
+		linear layout is subdivided. */
+		enum Layout {Tree, Linear};
+
+		/** Memory used for nodes other than the root. */
+		struct Statistics {
+			size_t nodes;
+			size_t peakNodes;
+			size_t bytes;
+			size_t peakBytes;
+		};
+
 		class Node {
-			Node *nodes;
+			friend class Volume;
+
+			/* Children and densities are atomic so that nodes can
+			be added from several threads. */
+			std::atomic<Node *> nodes;
 			Node *parent;
+			uint64_t key;
 			int depth;
 			Vec3 center;
 			float size;
 
-			float density;
+			std::atomic<float> density;
 			Vec3 direction;
 			int quantity;
 
 			Node();
-			Node *getAdjacentNode(int, Vec3, bool, int);
+			void initialize(Node *nodes, float density);
+			void divide(Node *nodes, float density);
 
 		public:
-			~Node();
 			Node(Vec3 center, float size);
+			Node(const Node &node);
+			Node &operator=(const Node &node);
 			Node *getParent();
 			Node *getNode(int index);
 			const Node *getNode(int index) const;
-			Node *getNextNode(int axis, Vec3 point, int depth);
-			Node *getPreviousNode(int axis, Vec3 point, int depth);
-			Node *getChildNode(Vec3 point, int depth);
-			Node *getAdjacentNode(Ray ray, int depth = 1000);
 			Vec3 getCenter() const;
 			float getSize() const;
 			int getDepth() const;
-			void divide();
-			void clear();
 
 			void setDensity(float density);
 			float getDensity() const;
@@ -60,20 +87,180 @@ namespace pg {
 			int getQuantity() const;
 		};
 
-		Volume(float size = 1.0f, int depth = 1);
+		/** Steps through the leaf nodes that a ray passes through with
+		the algorithm of Amanatides and Woo. Cells are stepped in
+		integer coordinates at the maximum depth, and a leaf that spans
+		several cells is crossed in a single step. */
+		class Traversal {
+			Volume *volume;
+			float origin[3];
+			float direction[3];
+			float inverse[3];
+			int64_t cell[3];
+			float length;
+			bool done;
+
+		public:
+			/** The ray must have a normalized direction. The
+			traversal ends after the ray travels the given
+			length. */
+			Traversal(Volume *volume, Ray ray, float length =
+				std::numeric_limits<float>::max());
+			/** Return the current leaf and move to the next. Leaves
+			that are not at the given depth are divided first. */
+			Node *next(int depth = 0);
+		};
+
+		Volume(float size = 1.0f, int depth = 1, Layout layout = Tree);
+		Volume(const Volume &) = delete;
+		Volume &operator=(const Volume &) = delete;
 		void clear(float size, int depth);
+		/** Change the layout and remove all nodes. */
+		void setLayout(Layout layout);
+		Layout getLayout() const;
+		/** Allow nodes, lines and capsules to be added from several
+		threads at once. Children of the tree layout are published with
+		compare-and-swap and lines and capsules only raise densities,
+		so threads do not wait for each other. Additions to the linear
+		layout move nodes and are serialized with a lock, so the linear
+		layout gains nothing from several threads. Other functions must
+		not be called while nodes are being added. */
+		void setConcurrent(bool concurrent);
+		bool isConcurrent() const;
+		int getDepth() const;
+		/** Return the divided nodes at a depth of the linear layout.
+		The tree layout does not keep track of divided nodes. */
+		std::vector<Node *> getDividedNodes(int depth);
+		/** Allocate memory for the given number of nodes in advance.
+		The memory is kept when the volume is cleared. */
+		void reserve(size_t size);
+		Statistics getStatistics() const;
+		/** Reset the light stored in each node. */
+		void clearFlux();
+		/** Divide the leaf at a point down to a depth. The children
+		inherit the density of a divided leaf. */
 		Node *addNode(Vec3 point, int depth = 1000);
+		/** Raise the density of the nodes that a line passes through
+		and of the leaves below them to the weight. The nodes are at the
+		depth of the radius. Densities are never lowered, so the order
+		of lines does not matter. */
 		void addLine(Vec3 a, Vec3 b, float weight, float radius);
+		/** Raise the density of every node that overlaps a capsule
+		whose radius changes linearly from a to b to the weight times
+		the fraction of the node that is inside the capsule. Capsules
+		are more accurate than lines but sample every node they overlap
+		instead of only the nodes on the axis, which makes them about
+		3 to 13 times slower, more so for thicker stems. */
+		void addCapsule(Vec3 a, Vec3 b, float radiusA, float radiusB,
+			float weight);
 		Node *getNode(Vec3 point);
+		/** Return the deepest node, which is at most as deep as the
+		given node, that is next to the node along an axis (0 to 2 for
+		x to z). Return null at the boundary of the volume. */
+		Node *getAdjacentNode(const Node *node, int axis,
+			bool positive);
 		Node *getRoot();
 		const Node *getRoot() const;
 
 	private:
 		float size;
 		int depth;
+		Layout layout;
 		Node root;
+		/* Nodes of the linear layout in blocks of eight siblings. */
+		std::vector<Node> nodes;
+		/* One plus the position of the deepest node of the linear
+		layout that contains each cell at the depth of the index. Zero
+		is the root. */
+		std::vector<uint32_t> index;
+		int indexDepth;
+		/* The first children of blocks grouped by the depth of
+		parents. */
+		std::vector<std::vector<size_t>> levels;
+		/* Nodes of the tree layout. Clearing the volume resets the
+		number of used nodes instead of freeing chunks. */
+		std::vector<std::unique_ptr<Node[]>> chunks;
+		size_t used;
+		size_t peakNodes;
+		size_t peakBytes;
+		bool concurrent;
+		/* Guards allocation in the concurrent mode. Blocks of children
+		that lost a race to be published are reused. */
+		std::mutex mutex;
+		std::vector<Node *> spare;
+
+		std::unique_lock<std::mutex> lockLinear();
+		Node *addNode(uint64_t code, int depth, bool inherit);
+		void addDensity(uint64_t code, int depth, float density);
+		void addDensity(Node *node, float density);
+		void clearFlux(Node *node);
+		Node *getNode(uint64_t code, int depth);
+		uint64_t getCode(Vec3 point) const;
+		Node *divide(Node *node, bool inherit);
+		Node *allocate();
+		void updateStatistics();
 
-		Node *getNode(Vec3 point, Node *node);
+#ifdef PG_SERIALIZE
+		friend class boost::serialization::access;
+		template<class Archive>
+		void save(Archive &ar, const unsigned) const
+		{
+			size_t count = getStatistics().nodes;
+			ar & size;
+			ar & depth;
+			ar & layout;
+			ar & count;
+			saveNode(ar, &root);
+		}
+		template<class Archive>
+		void saveNode(Archive &ar, const Node *node) const
+		{
+			bool divided = node->nodes != nullptr;
+			float density = node->density;
+			ar & divided;
+			ar & density;
+			ar & node->direction;
+			ar & node->quantity;
+			if (divided)
+				for (int i = 0; i < 8; i++)
+					saveNode(ar, node->getNode(i));
+		}
+		template<class Archive>
+		void load(Archive &ar, const unsigned)
+		{
+			float size;
+			int depth;
+			Layout layout;
+			size_t count;
+			ar & size;
+			ar & depth;
+			ar & layout;
+			ar & count;
+			setLayout(layout);
+			clear(size, depth);
+			/* Nodes of the linear layout are not moved while
+			loading. */
+			reserve(count);
+			loadNode(ar, &root);
+		}
+		template<class Archive>
+		void loadNode(Archive &ar, Node *node)
+		{
+			bool divided;
+			float density;
+			ar & divided;
+			ar & density;
+			ar & node->direction;
+			ar & node->quantity;
+			node->density = density;
+			if (divided) {
+				node = divide(node, false);
+				for (int i = 0; i < 8; i++)
+					loadNode(ar, node->getNode(i));
+			}
+		}
+		BOOST_SERIALIZATION_SPLIT_MEMBER()
+#endif
 	};
 }
 
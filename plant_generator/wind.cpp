@@ -101,7 +101,7 @@ void Wind::transformJoint(Plant *plant, Stem *stem, Vec3 previousPoint,
 {
 	const Path &path = stem->getPath();
 	const Spline &spline = path.getSpline();
-	vector<Joint> joints = stem->getJoints();
+	const vector<Joint> &joints = stem->getJoints();
 
 	for (size_t i = 0; i < joints.size(); i++) {
 		const Joint joint = joints[i];
@@ -136,7 +136,7 @@ void Wind::transformJoints(Stem *stem, int pid, Plant *plant, Vec3 point,
 	Stem *child = stem->getChild();
 	while (child) {
 		if (child->hasJoints()) {
-			Joint joint = child->getJoints()[0];
+			const Joint &joint = child->getJoints()[0];
 			if (joint.getParentID() == pid)
 				transformJoint(plant, child, point, animation);
 		}
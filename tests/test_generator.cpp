@@ -0,0 +1,599 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../plant_generator/generator.h"
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+
+using namespace pg;
+namespace bt = boost::unit_test;
+
+const float pi = 3.14159265359f;
+
+BOOST_AUTO_TEST_SUITE(generator)
+
+void setParameters(Generator &generator)
+{
+	generator.rays = 1000;
+	generator.cycles = 3;
+	generator.nodes = 2;
+	generator.seed = 7;
+}
+
+/* A default plant with a generator that grows it in a short time. */
+struct Fixture {
+	Plant plant;
+	Generator generator;
+
+	Fixture() : generator(&plant)
+	{
+		plant.setDefault();
+		setParameters(generator);
+	}
+};
+
+bool compareStems(const Stem *stem1, const Stem *stem2)
+{
+	while (stem1 && stem2) {
+		if (*stem1 != *stem2)
+			return false;
+		if (!compareStems(stem1->getChild(), stem2->getChild()))
+			return false;
+		stem1 = stem1->getSibling();
+		stem2 = stem2->getSibling();
+	}
+	return stem1 == stem2;
+}
+
+/* Compare the structure and the light of two volumes. */
+bool compareVolumes(const Volume::Node *node1, const Volume::Node *node2)
+{
+	if (!node1->getNode(0) || !node2->getNode(0)) {
+		return !node1->getNode(0) && !node2->getNode(0) &&
+			node1->getDensity() == node2->getDensity() &&
+			node1->getDirection() == node2->getDirection() &&
+			node1->getQuantity() == node2->getQuantity();
+	}
+	for (int i = 0; i < 8; i++)
+		if (!compareVolumes(node1->getNode(i), node2->getNode(i)))
+			return false;
+	return true;
+}
+
+/* Return the squared error of the light in the leaves of a volume. */
+float getFluxError(const Volume::Node *node, const Volume::Node *reference)
+{
+	if (!node->getNode(0)) {
+		Vec3 direction = reference->getDirection();
+		Vec3 difference = node->getDirection() - direction;
+		return dot(difference, difference);
+	}
+	float error = 0.0f;
+	for (int i = 0; i < 8; i++)
+		error += getFluxError(node->getNode(i), reference->getNode(i));
+	return error;
+}
+
+/* Return the light that reaches a point of the volume. */
+float getLight(Generator &generator, Vec3 point)
+{
+	Volume *volume = const_cast<Volume *>(generator.getVolume());
+	return magnitude(volume->getNode(point)->getDirection());
+}
+
+BOOST_FIXTURE_TEST_CASE(test_thread_count, Fixture)
+{
+	generator.threads = 1;
+	generator.estimateVariance = true;
+	generator.grow();
+
+	/* Every thread casts its own share of the rays, and the light is
+	merged in the same order regardless of the number of threads. */
+	int threads[] = {2, 3, 4};
+	for (int count : threads) {
+		Fixture fixture;
+		fixture.generator.threads = count;
+		fixture.generator.estimateVariance = true;
+		fixture.generator.grow();
+		BOOST_TEST(compareVolumes(generator.getVolume()->getRoot(),
+			fixture.generator.getVolume()->getRoot()));
+		BOOST_TEST(generator.getFluxVariance() ==
+			fixture.generator.getFluxVariance());
+		BOOST_TEST(compareStems(plant.getRoot(),
+			fixture.plant.getRoot()));
+	}
+	BOOST_TEST(plant.getRoot()->getChild() != nullptr);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_volume_layout, Fixture)
+{
+	generator.layout = Volume::Tree;
+	generator.grow();
+
+	Fixture linear;
+	linear.generator.layout = Volume::Linear;
+	linear.generator.grow();
+
+	Volume *volume = const_cast<Volume *>(linear.generator.getVolume());
+	BOOST_TEST(volume->getLayout() == Volume::Linear);
+	BOOST_TEST(!volume->getDividedNodes(1).empty());
+	BOOST_TEST(compareVolumes(generator.getVolume()->getRoot(),
+		volume->getRoot()));
+	BOOST_TEST(compareStems(plant.getRoot(), linear.plant.getRoot()));
+}
+
+/* Find the empty leaves below leaves of the given density. */
+void getShade(Volume &volume, Volume::Node *node, float density,
+	std::vector<Volume::Node *> &nodes)
+{
+	if (node->getNode(0)) {
+		for (int i = 0; i < 8; i++)
+			getShade(volume, node->getNode(i), density, nodes);
+		return;
+	}
+	float size = node->getSize();
+	Vec3 point = node->getCenter() + Vec3(0.0f, 0.0f, 2.0f * size);
+	if (node->getDensity() > 0.0f || point.z > volume.getRoot()->getSize())
+		return;
+	Volume::Node *above = volume.getNode(point);
+	if (above->getSize() == size && above->getDensity() == density)
+		nodes.push_back(node);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_shade, Fixture)
+{
+	generator.grow();
+
+	/* Rays that are blocked still reach the leaves behind a stem, so
+	those leaves receive less light on average than open leaves. */
+	Volume *volume = const_cast<Volume *>(generator.getVolume());
+	std::vector<Volume::Node *> shaded;
+	std::vector<Volume::Node *> open;
+	getShade(*volume, volume->getRoot(), 1.0f, shaded);
+	getShade(*volume, volume->getRoot(), 0.0f, open);
+	float light = 0.0f;
+	int count = 0;
+	for (Volume::Node *node : open) {
+		if (node->getQuantity() > 0) {
+			light += magnitude(node->getDirection());
+			count++;
+		}
+	}
+	BOOST_TEST(count > 0);
+	BOOST_TEST(!shaded.empty());
+	for (Volume::Node *node : shaded) {
+		BOOST_TEST(node->getQuantity() > 0);
+		float shade = magnitude(node->getDirection());
+		BOOST_TEST(shade < 0.5f * light / count);
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(test_sampling, Fixture)
+{
+	/* The light of a first cycle is compared with the light of many
+	more rays, so the error only depends on how the sky is sampled. */
+	Fixture reference;
+	reference.generator.cycles = 1;
+	reference.generator.nodes = 1;
+	reference.generator.rays = 200000;
+	reference.generator.seed = 0;
+	reference.generator.grow();
+	const Volume::Node *root = reference.generator.getVolume()->getRoot();
+
+	Generator::Sampling samplings[] = {
+		Generator::Random, Generator::Stratified, Generator::Sobol};
+	float errors[3] = {0.0f, 0.0f, 0.0f};
+	for (int i = 0; i < 3; i++) {
+		for (int seed = 0; seed < 16; seed++) {
+			Fixture fixture;
+			fixture.generator.cycles = 1;
+			fixture.generator.nodes = 1;
+			fixture.generator.seed = seed;
+			fixture.generator.sampling = samplings[i];
+			fixture.generator.grow();
+			const Volume *volume = fixture.generator.getVolume();
+			errors[i] += getFluxError(volume->getRoot(), root);
+		}
+	}
+	BOOST_TEST(errors[1] < errors[0]);
+	BOOST_TEST(errors[2] < 0.5f * errors[0]);
+
+	generator.estimateVariance = true;
+	generator.grow();
+	BOOST_TEST(generator.getFluxVariance() > 0.0f);
+	BOOST_TEST(generator.getFluxVariance() < 0.1f);
+	BOOST_TEST(reference.generator.getFluxVariance() == 0.0f);
+}
+
+/* Return the volume of the leaves weighted by their densities. */
+float getVolume(const Volume::Node *node)
+{
+	if (!node->getNode(0)) {
+		float size = 2.0f * node->getSize();
+		return node->getDensity() * size * size * size;
+	}
+	float volume = 0.0f;
+	for (int i = 0; i < 8; i++)
+		volume += getVolume(node->getNode(i));
+	return volume;
+}
+
+/* Return the volume of the frustums between the controls of stems. */
+float getVolume(Plant &plant, Stem *stem)
+{
+	float volume = 0.0f;
+	while (stem) {
+		const Path &path = stem->getPath();
+		for (size_t i = 1; i < path.getSize(); i++) {
+			float r1 = plant.getRadius(stem, i-1);
+			float r2 = plant.getRadius(stem, i);
+			float height = magnitude(path.get(i) - path.get(i-1));
+			volume += height * (r1*r1 + r1*r2 + r2*r2) * pi / 3.0f;
+		}
+		volume += getVolume(plant, stem->getChild());
+		stem = stem->getSibling();
+	}
+	return volume;
+}
+
+BOOST_AUTO_TEST_CASE(test_capsules)
+{
+	/* Lines fill every node they pass through, while capsules only
+	fill the fraction of a node that the stem covers. Segments in the
+	same node keep the larger fraction, so capsules can fall short of
+	the volume of the plant. */
+	Generator::Voxelization voxelizations[] = {
+		Generator::Lines, Generator::Capsules};
+	for (Generator::Voxelization voxelization : voxelizations) {
+		Fixture fixture;
+		Plant &plant = fixture.plant;
+		Generator &generator = fixture.generator;
+		generator.voxelization = voxelization;
+		/* The volume of an iteration holds the plant as it was after
+		the previous iteration. */
+		float expected = 0.0f;
+		int comparisons = 0;
+		generator.progress = [&](int, int iteration) {
+			if (iteration > 1) {
+				const Volume *volume = generator.getVolume();
+				float actual = getVolume(volume->getRoot());
+				if (voxelization == Generator::Capsules) {
+					BOOST_TEST(actual > 0.5f * expected);
+					BOOST_TEST(actual < 1.1f * expected);
+				} else
+					BOOST_TEST(actual > 100.0f * expected);
+				comparisons++;
+			}
+			expected = getVolume(plant, plant.getRoot());
+		};
+		generator.grow();
+		BOOST_TEST(comparisons == 3);
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(test_shadow_propagation, Fixture)
+{
+	generator.lightModel = Generator::ShadowPropagation;
+	generator.grow();
+
+	/* The plant shades the ground below it. */
+	float top = 1.9f * generator.getVolume()->getRoot()->getSize();
+	float light = getLight(generator, Vec3(0.0f, 0.0f, top));
+	BOOST_TEST(getLight(generator, Vec3(0.0f, 0.0f, 0.02f)) < light);
+	for (int count : generator.getRayCounts())
+		BOOST_TEST(count == 0);
+	BOOST_TEST(plant.getRoot()->getChild() != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_ray_tolerance)
+{
+	/* Looser tolerances stop casting rays sooner. */
+	float tolerances[] = {0.0f, 0.05f, 0.1f, 0.3f};
+	std::vector<int> previous;
+	for (float tolerance : tolerances) {
+		Fixture fixture;
+		Generator &generator = fixture.generator;
+		generator.rays = 8000;
+		generator.tolerance = tolerance;
+		generator.grow();
+
+		const std::vector<int> &counts = generator.getRayCounts();
+		BOOST_TEST(counts.size() == 3);
+		for (size_t i = 0; i < counts.size(); i++) {
+			if (tolerance == 0.0f)
+				BOOST_TEST(counts[i] == 8000 * generator.nodes);
+			else
+				BOOST_TEST(counts[i] <= previous[i]);
+		}
+		if (tolerance > 0.0f)
+			BOOST_TEST(counts != previous);
+		previous = counts;
+	}
+}
+
+BOOST_FIXTURE_TEST_CASE(test_progress, Fixture)
+{
+	Fixture reference;
+	reference.generator.grow();
+
+	std::vector<std::pair<int, int>> calls;
+	generator.progress = [&](int cycle, int node) {
+		calls.push_back(std::make_pair(cycle, node));
+		if (cycle == 1 && node == 1)
+			generator.cancel();
+	};
+	generator.grow();
+
+	BOOST_TEST(generator.isCancelled());
+	BOOST_TEST(calls.size() == 3);
+	BOOST_TEST((calls[0] == std::make_pair(0, 1)));
+	BOOST_TEST((calls[2] == std::make_pair(1, 1)));
+	BOOST_TEST(generator.getRayCounts().size() == 2);
+	BOOST_TEST(generator.getTime(Generator::CastRays) > 0.0);
+	BOOST_TEST(generator.getTime(Generator::AddToVolume) > 0.0);
+
+	generator.progress = nullptr;
+	generator.resume();
+	while (generator.growCycle());
+	BOOST_TEST(generator.getCycle() == 3);
+	const std::vector<int> &counts = reference.generator.getRayCounts();
+	BOOST_TEST(generator.getRayCounts() == counts);
+	BOOST_TEST(compareStems(reference.plant.getRoot(), plant.getRoot()));
+}
+
+BOOST_FIXTURE_TEST_CASE(test_cancel, Fixture)
+{
+	Fixture reference;
+	reference.generator.grow();
+
+	/* Growth is stopped at whatever phase the other thread reaches. */
+	generator.start();
+	std::atomic<bool> done(false);
+	std::thread canceller([&]() {
+		std::chrono::milliseconds delay(1);
+		for (int i = 0; i < 20 && !done; i++) {
+			generator.cancel();
+			std::this_thread::sleep_for(delay);
+		}
+	});
+	int cancellations = 0;
+	while (generator.getCycle() < generator.cycles) {
+		if (!generator.growCycle())
+			cancellations++;
+		generator.resume();
+	}
+	done = true;
+	canceller.join();
+
+	BOOST_TEST(cancellations > 0);
+	const std::vector<int> &counts = reference.generator.getRayCounts();
+	BOOST_TEST(generator.getRayCounts() == counts);
+	BOOST_TEST(compareStems(reference.plant.getRoot(), plant.getRoot()));
+}
+
+BOOST_FIXTURE_TEST_CASE(test_checkpoint, Fixture)
+{
+	Fixture reference;
+	reference.generator.grow();
+
+	std::stringstream stream;
+	{
+		Fixture fixture;
+		fixture.generator.start();
+		BOOST_TEST(fixture.generator.growCycle());
+		BOOST_TEST(fixture.generator.growCycle());
+		boost::archive::text_oarchive oa(stream);
+		oa << fixture.generator;
+	}
+
+	boost::archive::text_iarchive ia(stream);
+	ia >> generator;
+	BOOST_TEST(generator.getCycle() == 2);
+	BOOST_TEST(generator.growCycle());
+	BOOST_TEST(!generator.growCycle());
+	const std::vector<int> &counts = reference.generator.getRayCounts();
+	BOOST_TEST(generator.getRayCounts() == counts);
+	BOOST_TEST(compareStems(reference.plant.getRoot(), plant.getRoot()));
+}
+
+BOOST_FIXTURE_TEST_CASE(test_checkpoint_count, Fixture)
+{
+	std::vector<Vec3> positions = {
+		Vec3(-1.0f, 0.0f, 0.0f), Vec3(1.0f, 0.0f, 0.0f)};
+	Plant plants[2];
+	plants[0].setDefault();
+	plants[1].setDefault();
+	std::vector<Plant *> forest = {&plants[0], &plants[1]};
+	std::stringstream stream;
+	{
+		Generator generator(nullptr);
+		setParameters(generator);
+		generator.start(forest, positions);
+		BOOST_TEST(generator.growCycle());
+		boost::archive::text_oarchive oa(stream);
+		oa << generator;
+	}
+
+	generator.start();
+	boost::archive::text_iarchive ia(stream);
+	BOOST_CHECK_THROW(ia >> generator,
+		boost::archive::archive_exception);
+	BOOST_TEST(generator.getCycle() == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_forest, Fixture)
+{
+	std::vector<Vec3> positions = {
+		Vec3(-1.0f, 0.0f, 0.0f), Vec3(1.0f, 0.0f, 0.0f),
+		Vec3(0.0f, 1.5f, 0.0f)};
+	Plant plants[3];
+	std::vector<Plant *> forest;
+	for (int i = 0; i < 3; i++) {
+		plants[i].setDefault();
+		forest.push_back(&plants[i]);
+	}
+	Generator stand(nullptr);
+	setParameters(stand);
+	stand.lightModel = Generator::ShadowPropagation;
+	stand.grow(forest, positions);
+
+	generator.lightModel = Generator::ShadowPropagation;
+	generator.grow();
+
+	/* Neighbours shade the base of each plant more than the plant
+	shades itself. */
+	float light = getLight(generator, Vec3(0.0f, 0.0f, 0.02f));
+	for (int i = 0; i < 3; i++) {
+		const Stem *root = plants[i].getRoot();
+		Vec3 base = positions[i] + Vec3(0.0f, 0.0f, 0.02f);
+		BOOST_TEST(root->getPath().get(0) == positions[i]);
+		BOOST_TEST(root->getChild() != nullptr);
+		BOOST_TEST(getLight(stand, base) < light);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_missing_positions)
+{
+	Plant plants[2];
+	Generator generator(nullptr);
+	generator.start({&plants[0], &plants[1]}, {Vec3(1.0f, 2.0f, 0.0f)});
+	const Path &path0 = plants[0].getRoot()->getPath();
+	const Path &path1 = plants[1].getRoot()->getPath();
+	BOOST_TEST(path0.get(0) == Vec3(1.0f, 2.0f, 0.0f));
+	BOOST_TEST(path1.get(0) == Vec3(0.0f, 0.0f, 0.0f));
+}
+
+struct Segment {
+	Vec3 a;
+	Vec3 b;
+	float radiusA;
+	float radiusB;
+};
+
+void getSegments(Plant &plant, Stem *stem, std::vector<Segment> &segments)
+{
+	while (stem) {
+		const Path &path = stem->getPath();
+		Vec3 location = stem->getLocation();
+		for (size_t i = 1; i < path.getSize(); i++) {
+			Segment segment;
+			segment.a = location + path.get(i-1);
+			segment.b = location + path.get(i);
+			segment.radiusA = plant.getRadius(stem, i-1);
+			segment.radiusB = plant.getRadius(stem, i);
+			segments.push_back(segment);
+		}
+		getSegments(plant, stem->getChild(), segments);
+		stem = stem->getSibling();
+	}
+}
+
+void addSegments(Volume &volume, const std::vector<Segment> &segments,
+	Generator::Voxelization voxelization)
+{
+	for (const Segment &s : segments) {
+		if (voxelization == Generator::Capsules)
+			volume.addCapsule(s.a, s.b, s.radiusA, s.radiusB, 1.0f);
+		else
+			volume.addLine(s.a, s.b, 1.0f, s.radiusB);
+	}
+}
+
+/* Compare the leaves of a volume with a volume that was built at once. */
+bool compareDensities(const Volume::Node *node, Volume &volume)
+{
+	if (node->getNode(0)) {
+		for (int i = 0; i < 8; i++)
+			if (!compareDensities(node->getNode(i), volume))
+				return false;
+		return true;
+	}
+	Volume::Node *leaf = volume.getNode(node->getCenter());
+	return leaf->getDensity() == node->getDensity();
+}
+
+BOOST_AUTO_TEST_CASE(test_volume_update)
+{
+	/* Optimization replaces the last control of stems, and the positions
+	keep the plants from outgrowing the volume, so the volume is often
+	updated instead of rebuilt. */
+	std::vector<Vec3> positions = {
+		Vec3(-4.0f, 0.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f),
+		Vec3(4.0f, 0.0f, 0.0f)};
+	Generator::Voxelization voxelizations[] = {
+		Generator::Lines, Generator::Capsules};
+	for (Generator::Voxelization voxelization : voxelizations) {
+		Plant plants[3];
+		std::vector<Plant *> forest;
+		for (int i = 0; i < 3; i++) {
+			plants[i].setDefault();
+			forest.push_back(&plants[i]);
+		}
+
+		Generator generator(nullptr);
+		setParameters(generator);
+		generator.nodes = 4;
+		generator.optimization = 0.3f;
+		generator.voxelization = voxelization;
+		/* The volume of an iteration holds the plants as they were
+		after the previous iteration of the same cycle. */
+		std::vector<Segment> segments;
+		int comparisons = 0;
+		generator.progress = [&](int, int iteration) {
+			if (iteration > 1) {
+				const Volume *volume = generator.getVolume();
+				const Volume::Node *root = volume->getRoot();
+				float size = 2.0f * root->getSize();
+				Volume expected(size, volume->getDepth());
+				addSegments(expected, segments, voxelization);
+				BOOST_TEST(compareDensities(root, expected));
+				comparisons++;
+			}
+			segments.clear();
+			for (Plant &plant : plants)
+				getSegments(plant, plant.getRoot(), segments);
+		};
+		generator.grow(forest, positions);
+		BOOST_TEST(comparisons == 9);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_compact)
+{
+	StemPool::Occupancy occupancy[2];
+	Fixture fixtures[2];
+	for (int i = 0; i < 2; i++) {
+		Plant &plant = fixtures[i].plant;
+		Generator &generator = fixtures[i].generator;
+		plant.getStemPool()->setPoolCapacity(4);
+		generator.cycles = 8;
+		generator.synthesisThreshold = 0.1f;
+		generator.compact = i == 1;
+		generator.grow();
+		occupancy[i] = plant.getStemPool()->getOccupancy();
+	}
+
+	const Stem *root = fixtures[1].plant.getRoot();
+	BOOST_TEST(compareStems(fixtures[0].plant.getRoot(), root));
+	BOOST_TEST(occupancy[0].allocated == occupancy[1].allocated);
+	BOOST_TEST(occupancy[1].capacity < occupancy[0].capacity);
+	BOOST_TEST(2 * occupancy[1].allocated >= occupancy[1].capacity);
+}
+
+BOOST_AUTO_TEST_CASE(test_nested_loops)
+{
+	TaskPool pool(4);
+	std::atomic<size_t> sum(0);
+	pool.parallelFor(8, [&](size_t i) {
+		pool.parallelFor(100, [&](size_t j) {
+			sum += i * 100 + j;
+		});
+	});
+	BOOST_TEST(sum == 799 * 800 / 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,18 +1,27 @@
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
+#include <boost/test/data/test_case.hpp>
 
 #include "../plant_generator/volume.h"
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
 
 using namespace pg;
 namespace bt = boost::unit_test;
+namespace bdata = boost::unit_test::data;
+
+const Volume::Layout layouts[] = {Volume::Tree, Volume::Linear};
 
 const float tolerance = 0.000001f;
 
 BOOST_AUTO_TEST_SUITE(octree)
 
-BOOST_AUTO_TEST_CASE(test_get_node, *bt::tolerance(tolerance))
+BOOST_TEST_DECORATOR(*bt::tolerance(tolerance))
+BOOST_DATA_TEST_CASE(test_get_node, bdata::make(layouts), layout)
 {
-	Volume volume(1.0f, 3);
+	Volume volume(1.0f, 3, layout);
 	Vec3 point(0.76f-0.5f, 0.126f-0.5f, 0.26f);
 	Volume::Node *node1 = volume.addNode(point);
 	Volume::Node *node2 = volume.getNode(point);
@@ -23,11 +32,43 @@ BOOST_AUTO_TEST_CASE(test_get_node, *bt::tolerance(tolerance))
 	BOOST_TEST(center.z == 0.3125f);
 }
 
-BOOST_AUTO_TEST_CASE(test_add_line)
+BOOST_DATA_TEST_CASE(test_adjacent_node, bdata::make(layouts), layout)
 {
-	/* This test will fail if the ray direction is diagonal to the volume
-	due to floating point precision errors. */
-	Volume volume(1.0f, 3);
+	/* The linear layout looks up nodes below the depth of its index by
+	following children. */
+	Volume volume(1.0f, 8, layout);
+	Vec3 point(0.1f, -0.2f, 0.3f);
+	Volume::Node *node = volume.addNode(point);
+	BOOST_TEST(node->getDepth() == 8);
+	BOOST_TEST(volume.getNode(point) == node);
+	float width = 1.0f / 256.0f;
+	Vec3 offsets[3] = {
+		Vec3(width, 0.0f, 0.0f),
+		Vec3(0.0f, width, 0.0f),
+		Vec3(0.0f, 0.0f, width)};
+	for (int axis = 0; axis < 3; axis++) {
+		Volume::Node *next = volume.getAdjacentNode(node, axis, true);
+		BOOST_TEST(next == volume.getNode(point + offsets[axis]));
+		next = volume.getAdjacentNode(node, axis, false);
+		BOOST_TEST(next == volume.getNode(point - offsets[axis]));
+	}
+
+	/* Neighbors of coarse nodes are at most as deep as the node. */
+	Volume::Node *coarse = volume.getNode(Vec3(-0.3f, 0.2f, 0.7f));
+	BOOST_TEST(coarse->getDepth() == 1);
+	Volume::Node *next = volume.getAdjacentNode(coarse, 0, true);
+	BOOST_TEST(next == volume.getNode(Vec3(0.2f, 0.2f, 0.7f)));
+	BOOST_TEST(next->getDepth() == 1);
+
+	Volume::Node *corner = volume.addNode(Vec3(-0.499f, -0.499f, 0.001f));
+	for (int axis = 0; axis < 3; axis++)
+		BOOST_TEST(!volume.getAdjacentNode(corner, axis, false));
+	BOOST_TEST(!volume.getAdjacentNode(volume.getRoot(), 0, true));
+}
+
+BOOST_DATA_TEST_CASE(test_add_line, bdata::make(layouts), layout)
+{
+	Volume volume(1.0f, 3, layout);
 	Vec3 a(-0.5f, -0.5f, 0.1f);
 	Vec3 b(0.99f-0.5f, 0.01f-0.5f, 0.01f);
 	Vec3 c(0.51f, 0.50f, 0.1f);
@@ -47,4 +88,260 @@ BOOST_AUTO_TEST_CASE(test_add_line)
 	BOOST_TEST(node3->getDensity() == weight);
 }
 
+BOOST_DATA_TEST_CASE(test_add_diagonal_line, bdata::make(layouts), layout)
+{
+	Volume volume(1.0f, 3, layout);
+	Vec3 a(-0.4375f, -0.4375f, 0.0625f);
+	Vec3 b(0.4375f, 0.4375f, 0.9375f);
+	float weight = 0.6f;
+
+	volume.addLine(a, b, weight, 0.001f);
+	for (int i = 0; i < 8; i++) {
+		Vec3 point = a + 0.125f * Vec3(i, i, i);
+		Volume::Node *node = volume.getNode(point);
+		BOOST_TEST(node->getDepth() == 3);
+		BOOST_TEST(node->getDensity() == weight);
+	}
+	Volume::Node *node = volume.getNode(Vec3(0.0625f, -0.0625f, 0.5625f));
+	BOOST_TEST(node->getDensity() == 0.0f);
+}
+
+BOOST_DATA_TEST_CASE(test_add_line_to_coarse_node, bdata::make(layouts),
+	layout)
+{
+	Volume volume(1.0f, 3, layout);
+	Vec3 a(-0.4f, -0.4f, 0.1f);
+	Vec3 b(-0.3f, -0.4f, 0.1f);
+	Vec3 c(-0.4f, -0.3f, 0.1f);
+	volume.addLine(a, b, 0.5f, 0.2f);
+	BOOST_TEST(volume.getNode(c)->getDepth() == 1);
+	BOOST_TEST(volume.getNode(c)->getDensity() == 0.5f);
+
+	/* A thinner line divides the node, and the children that it does not
+	pass through keep the density of the node. */
+	volume.getNode(c)->setQuantity(2);
+	volume.addLine(a, b, 0.8f, 0.001f);
+	BOOST_TEST(volume.getNode(a)->getDepth() == 3);
+	BOOST_TEST(volume.getNode(a)->getDensity() == 0.8f);
+	BOOST_TEST(volume.getNode(c)->getDensity() == 0.5f);
+	BOOST_TEST(volume.getNode(c)->getQuantity() == 0);
+
+	/* A thicker line raises every leaf below the node it passes. */
+	volume.addLine(a, b, 0.6f, 0.2f);
+	BOOST_TEST(volume.getNode(a)->getDensity() == 0.8f);
+	BOOST_TEST(volume.getNode(c)->getDensity() == 0.6f);
+
+	volume.getNode(a)->setQuantity(2);
+	volume.clearFlux();
+	BOOST_TEST(volume.getNode(a)->getQuantity() == 0);
+	BOOST_TEST(volume.getNode(a)->getDensity() == 0.8f);
+}
+
+BOOST_DATA_TEST_CASE(test_add_capsule_to_coarse_node, bdata::make(layouts),
+	layout)
+{
+	Volume volume(1.0f, 3, layout);
+	Vec3 a(-0.4f, -0.4f, 0.1f);
+	Vec3 b(-0.3f, -0.4f, 0.1f);
+	Vec3 c(-0.4f, -0.3f, 0.1f);
+	volume.addCapsule(a, b, 0.2f, 0.2f, 1.0f);
+	BOOST_TEST(volume.getNode(c)->getDepth() == 1);
+	float density = volume.getNode(c)->getDensity();
+	BOOST_TEST(density > 0.0f);
+
+	/* Capsules only raise densities, so the children of the divided node
+	keep its density. */
+	volume.addCapsule(a, b, 0.001f, 0.001f, 1.0f);
+	BOOST_TEST(volume.getNode(a)->getDepth() == 3);
+	BOOST_TEST(volume.getNode(a)->getDensity() == density);
+	BOOST_TEST(volume.getNode(c)->getDepth() == 3);
+	BOOST_TEST(volume.getNode(c)->getDensity() == density);
+}
+
+BOOST_DATA_TEST_CASE(test_add_capsule, bdata::make(layouts), layout)
+{
+	Volume volume(1.0f, 2, layout);
+	Vec3 a(0.125f, 0.125f, 0.1f);
+	Vec3 b(0.125f, 0.125f, 0.9f);
+	volume.addCapsule(a, b, 0.1f, 0.1f, 0.5f);
+
+	/* The capsule covers the area of a circle with a radius of 0.4 cells
+	in the cells along its axis. */
+	float area = 3.14159265f * 0.4f * 0.4f;
+	Volume::Node *node = volume.getNode(Vec3(0.125f, 0.125f, 0.5f));
+	BOOST_TEST(node->getDepth() == 2);
+	BOOST_TEST(std::abs(node->getDensity() - 0.5f * area) < 0.02f);
+	node = volume.getNode(Vec3(0.125f, 0.125f, 0.125f));
+	BOOST_TEST(node->getDensity() > 0.0f);
+	BOOST_TEST(node->getDensity() < 0.5f * area);
+	node = volume.getNode(Vec3(0.375f, 0.125f, 0.5f));
+	BOOST_TEST(node->getDensity() == 0.0f);
+	node = volume.getNode(Vec3(-0.1f, 0.125f, 0.5f));
+	BOOST_TEST(node->getDensity() == 0.0f);
+}
+
+BOOST_DATA_TEST_CASE(test_add_thin_capsule, bdata::make(layouts), layout)
+{
+	Volume volume(1.0f, 2, layout);
+	Vec3 a(0.1f, 0.1f, 0.3f);
+	Vec3 b(0.1f, 0.1f, 0.7f);
+	volume.addCapsule(a, b, 0.001f, 0.002f, 1.0f);
+
+	/* The capsule is too thin to cover any sample of the cells, so its
+	volume is estimated from the length of the axis inside a cell. */
+	float width = 0.25f;
+	float radius = 0.001f + 0.001f * 0.25f;
+	float density = 3.14159265f * radius * radius * 0.2f;
+	density /= width * width * width;
+	Volume::Node *node = volume.getNode(Vec3(0.1f, 0.1f, 0.4f));
+	BOOST_TEST(node->getDepth() == 2);
+	BOOST_TEST(std::abs(node->getDensity() / density - 1.0f) < 0.001f);
+	node = volume.getNode(Vec3(0.1f, 0.1f, 0.6f));
+	BOOST_TEST(node->getDensity() > density);
+}
+
+bool compareNodes(const Volume::Node *node1, const Volume::Node *node2)
+{
+	if (node1->getDensity() != node2->getDensity())
+		return false;
+	if (!node1->getNode(0) || !node2->getNode(0))
+		return !node1->getNode(0) && !node2->getNode(0);
+	for (int i = 0; i < 8; i++)
+		if (!compareNodes(node1->getNode(i), node2->getNode(i)))
+			return false;
+	return true;
+}
+
+BOOST_DATA_TEST_CASE(test_concurrent_insertion, bdata::make(layouts),
+	layout)
+{
+	const int threads = 8;
+	const int capsules = 400;
+	std::vector<Vec3> points;
+	std::vector<float> radii;
+	std::mt19937 mt(3);
+	std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+	for (int i = 0; i < capsules; i++) {
+		for (int j = 0; j < 2; j++) {
+			float x = distribution(mt);
+			float y = distribution(mt);
+			float z = distribution(mt) + 0.5f;
+			points.push_back(Vec3(x, y, z));
+		}
+		radii.push_back(0.05f * (distribution(mt) + 0.5f));
+	}
+
+	Volume volume1(1.0f, 6, layout);
+	for (int i = 0; i < capsules; i++) {
+		volume1.addCapsule(points[2*i], points[2*i+1], radii[i],
+			0.5f * radii[i], 0.1f + i % 9 * 0.1f);
+		volume1.addNode(points[2*i], 6);
+	}
+
+	Volume volume2(1.0f, 6, layout);
+	volume2.setConcurrent(true);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			for (int i = t; i < capsules; i += threads) {
+				int k = capsules - 1 - i;
+				volume2.addCapsule(points[2*k], points[2*k+1],
+					radii[k], 0.5f * radii[k],
+					0.1f + k % 9 * 0.1f);
+				volume2.addNode(points[2*k], 6);
+			}
+		});
+	}
+	for (std::thread &worker : workers)
+		worker.join();
+	volume2.setConcurrent(false);
+
+	BOOST_TEST(volume1.getRoot()->getNode(0) != nullptr);
+	BOOST_TEST(compareNodes(volume1.getRoot(), volume2.getRoot()));
+}
+
+BOOST_DATA_TEST_CASE(test_concurrent_lines, bdata::make(layouts), layout)
+{
+	const int threads = 8;
+	const int lines = 400;
+	std::vector<Vec3> points;
+	std::mt19937 mt(5);
+	std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+	for (int i = 0; i < 2 * lines; i++) {
+		float x = distribution(mt);
+		float y = distribution(mt);
+		float z = distribution(mt) + 0.5f;
+		points.push_back(Vec3(x, y, z));
+	}
+
+	/* Lines only raise densities, so they can be added in any order. */
+	Volume volume1(1.0f, 6, layout);
+	for (int i = 0; i < lines; i++)
+		volume1.addLine(points[2*i], points[2*i+1],
+			0.1f * (i % 9 + 1), 0.05f);
+
+	Volume volume2(1.0f, 6, layout);
+	volume2.setConcurrent(true);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.emplace_back([&, t]() {
+			for (int i = t; i < lines; i += threads) {
+				int k = lines - 1 - i;
+				volume2.addLine(points[2*k], points[2*k+1],
+					0.1f * (k % 9 + 1), 0.05f);
+			}
+		});
+	}
+	for (std::thread &worker : workers)
+		worker.join();
+	volume2.setConcurrent(false);
+
+	BOOST_TEST(volume1.getRoot()->getNode(0) != nullptr);
+	BOOST_TEST(compareNodes(volume1.getRoot(), volume2.getRoot()));
+}
+
+BOOST_DATA_TEST_CASE(test_traversal, bdata::make(layouts), layout)
+{
+	Volume volume(1.0f, 3, layout);
+	Vec3 a(-0.3f, 0.2f, 0.9f);
+	Vec3 b(0.1f, -0.4f, 0.3f);
+	volume.addLine(a, b, 0.4f, 0.3f);
+
+	Ray ray(Vec3(0.0f, 0.0f, 0.99f), Vec3(0.0f, 0.0f, -1.0f));
+	Volume::Traversal traversal(&volume, ray);
+	Volume::Node *node = traversal.next();
+	float z = 1.0f;
+	while (node) {
+		Vec3 center = node->getCenter();
+		float size = node->getSize();
+		BOOST_TEST(center.z + size == z);
+		BOOST_TEST(std::abs(center.x) <= size);
+		BOOST_TEST(std::abs(center.y) <= size);
+		z = center.z - size;
+		node = traversal.next();
+	}
+	BOOST_TEST(z == 0.0f);
+}
+
+BOOST_DATA_TEST_CASE(test_statistics, bdata::make(layouts), layout)
+{
+	Volume volume(1.0f, 2, layout);
+	volume.addNode(Vec3(0.1f, 0.1f, 0.1f));
+	Volume::Statistics statistics = volume.getStatistics();
+	BOOST_TEST(statistics.nodes == 16);
+	BOOST_TEST(statistics.peakNodes == 16);
+	BOOST_TEST(statistics.bytes >= 16 * sizeof(Volume::Node));
+
+	volume.clear(1.0f, 2);
+	BOOST_TEST(volume.getRoot()->getNode(0) == nullptr);
+	BOOST_TEST(volume.getStatistics().nodes == 0);
+	BOOST_TEST(volume.getStatistics().peakNodes == 16);
+	BOOST_TEST(volume.getStatistics().bytes == statistics.bytes);
+
+	volume.addNode(Vec3(-0.1f, 0.1f, 0.1f), 1);
+	BOOST_TEST(volume.getStatistics().nodes == 8);
+	BOOST_TEST(volume.getNode(Vec3(-0.1f, 0.1f, 0.1f))->getDepth() == 1);
+	BOOST_TEST(volume.getStatistics().peakNodes == 16);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include "../plant_generator/path.h"
+#include "../plant_generator/plant.h"
 
 using namespace pg;
 namespace bt = boost::unit_test;
@@ -31,4 +32,55 @@ BOOST_AUTO_TEST_CASE(test_get_index)
 	BOOST_TEST(path.toPathIndex(3) == 1);
 }
 
+BOOST_AUTO_TEST_CASE(test_references)
+{
+	Path path;
+	path.setSpline(createCubicSpline());
+	path.generate();
+	const Spline &spline = path.getSpline();
+	const std::vector<Vec3> &points = path.get();
+	BOOST_TEST(&spline == &path.getSpline());
+	BOOST_TEST(&spline.getControls() == &path.getSpline().getControls());
+	BOOST_TEST(&points == &path.get());
+	BOOST_TEST(points.size() == path.getSize());
+	BOOST_TEST(spline.getControls().size() == 7);
+	BOOST_TEST(spline.getDirection(6) == Vec3(0.0f, 1.0f, 0.0f));
+}
+
+BOOST_AUTO_TEST_CASE(test_radius_cache)
+{
+	Plant plant;
+	plant.setDefault();
+	Stem *root = plant.createRoot();
+	Path path;
+	Spline spline;
+	spline.setDegree(1);
+	spline.addControl(Vec3(0.0f, 0.0f, 0.0f));
+	spline.addControl(Vec3(0.0f, 4.0f, 0.0f));
+	spline.addControl(Vec3(1.0f, 10.0f, 0.0f));
+	path.setSpline(spline);
+	root->setPath(path);
+	root->setMaxRadius(1.0f);
+	root->setMinRadius(0.1f);
+
+	auto getRadius = [&](unsigned index) {
+		Spline curve = plant.getCurve(0).getSpline();
+		float t = root->getPath().getPercentage(index);
+		float z = curve.getPoint(t).y;
+		float range = root->getMaxRadius() - root->getMinRadius();
+		return z * range + root->getMinRadius();
+	};
+	size_t size = root->getPath().getSize();
+	BOOST_TEST(size > 2);
+	for (unsigned i = 0; i < size; i++)
+		BOOST_TEST(plant.getRadius(root, i) == getRadius(i));
+
+	root->setMaxRadius(2.0f);
+	BOOST_TEST(plant.getRadius(root, 0) == 2.0f);
+	plant.updateCurve(Curve(3), 0);
+	for (unsigned i = 0; i < size; i++)
+		BOOST_TEST(plant.getRadius(root, i) == getRadius(i));
+	BOOST_TEST(plant.getRadius(root, 0) == 0.1f);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
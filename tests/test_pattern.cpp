@@ -0,0 +1,233 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../plant_generator/pattern_generator.h"
+#include "../plant_generator/philox.h"
+#include "../plant_generator/variant_generator.h"
+
+using namespace pg;
+namespace bt = boost::unit_test;
+
+BOOST_AUTO_TEST_SUITE(pattern_generator)
+
+bool compareTrees(const Stem *stem1, const Stem *stem2, int &count)
+{
+	while (stem1 && stem2) {
+		if (*stem1 != *stem2)
+			return false;
+		if (!compareTrees(stem1->getChild(), stem2->getChild(), count))
+			return false;
+		stem1 = stem1->getSibling();
+		stem2 = stem2->getSibling();
+		count++;
+	}
+	return stem1 == stem2;
+}
+
+void initializeTree(ParameterTree &tree)
+{
+	ParameterNode *root = tree.createRoot();
+	StemData data;
+	data.seed = 11;
+	data.radiusThreshold = 0.1f;
+	root->setData(data);
+	data.density = 1.0f;
+	data.densityCurve.setDefault(1);
+	data.distance = 10.0f;
+	data.radius = 0.9f;
+	data.radiusThreshold = 0.03f;
+	data.leaf.density = 3.0f;
+	data.leaf.densityCurve.setDefault(1);
+	tree.addChild("")->setData(data);
+	data.density = 4.0f;
+	data.distance = 4.0f;
+	data.length = 100.0f;
+	data.radiusThreshold = 0.01f;
+	data.angleVariation = 0.2f;
+	data.fork = 0.02f;
+	tree.addChild("1")->setData(data);
+	tree.addChild("1.1")->setData(data);
+}
+
+BOOST_AUTO_TEST_CASE(test_philox)
+{
+	uint32_t block[4];
+	uint32_t key1[2] = {0, 0};
+	uint32_t counter1[4] = {0, 0, 0, 0};
+	Philox::getBlock(key1, counter1, block);
+	BOOST_TEST(block[0] == 0x6627e8d5);
+	BOOST_TEST(block[1] == 0xe169c58d);
+	BOOST_TEST(block[2] == 0xbc57ac4c);
+	BOOST_TEST(block[3] == 0x9b00dbd8);
+	uint32_t key2[2] = {0xa4093822, 0x299f31d0};
+	uint32_t counter2[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+	Philox::getBlock(key2, counter2, block);
+	BOOST_TEST(block[0] == 0xd16cfe09);
+	BOOST_TEST(block[1] == 0x94fdcceb);
+	BOOST_TEST(block[2] == 0x5001e420);
+	BOOST_TEST(block[3] == 0x24126ea1);
+
+	Philox random1(5, 9);
+	Philox random2(5, 9);
+	for (int i = 0; i < 11; i++)
+		random1();
+	random2.discard(11);
+	BOOST_TEST(random1() == random2());
+	BOOST_TEST(Philox(5, 9)() != Philox(5, 10)());
+}
+
+BOOST_AUTO_TEST_CASE(test_threads)
+{
+	ParameterTree tree;
+	initializeTree(tree);
+	Plant plant1;
+	plant1.setDefault();
+	PatternGenerator generator1(&plant1);
+	generator1.setParameterTree(tree);
+	generator1.grow();
+
+	for (int threads : {2, 5}) {
+		Plant plant2;
+		plant2.setDefault();
+		PatternGenerator generator2(&plant2);
+		generator2.setParameterTree(tree);
+		generator2.setThreads(threads);
+		generator2.grow();
+		int count = 0;
+		BOOST_TEST(compareTrees(plant1.getRoot(), plant2.getRoot(),
+			count));
+		BOOST_TEST(count > 100);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_forks)
+{
+	ParameterTree tree;
+	initializeTree(tree);
+	tree.updateField([](StemData *data) {
+		data->fork = 1.0f;
+	}, "1");
+	Plant plant1;
+	plant1.setDefault();
+	PatternGenerator generator1(&plant1);
+	generator1.setParameterTree(tree);
+	generator1.grow();
+
+	Plant plant2;
+	plant2.setDefault();
+	PatternGenerator generator2(&plant2);
+	generator2.setParameterTree(tree);
+	generator2.setThreads(3);
+	generator2.grow();
+
+	int forks = 0;
+	const Stem *trunk = plant1.getRoot();
+	for (const Stem *stem = trunk->getChild(); stem;
+		stem = stem->getSibling()) {
+		const Stem *child = stem->getChild();
+		for (; child; child = child->getSibling()) {
+			if (child->getDistance() < stem->getPath().getLength())
+				continue;
+			float radius = stem->getMinRadius();
+			BOOST_TEST(child->getMaxRadius() <= radius);
+			forks++;
+		}
+	}
+	int count = 0;
+	BOOST_TEST(forks > 0);
+	BOOST_TEST(compareTrees(trunk, plant2.getRoot(), count));
+}
+
+BOOST_AUTO_TEST_CASE(test_update)
+{
+	ParameterTree tree;
+	initializeTree(tree);
+	Plant plant1;
+	plant1.setDefault();
+	PatternGenerator generator1(&plant1);
+	generator1.setParameterTree(tree);
+	generator1.setThreads(3);
+	generator1.grow();
+	Stem *root = plant1.getRoot();
+	std::vector<Stem *> stems;
+	for (Stem *stem = root->getChild(); stem; stem = stem->getSibling())
+		stems.push_back(stem);
+
+	ParameterTree changedTree = root->getParameterTree();
+	BOOST_TEST(!changedTree.getRoot()->isDirty());
+	changedTree.updateField([](StemData *data) {
+		data->density = 2.0f;
+		data->leaf.density = 1.0f;
+	}, "1.1.1");
+	root->setParameterTree(changedTree);
+	BOOST_TEST(generator1.update(root));
+	BOOST_TEST(!root->getParameterTree().get("1.1.1")->isDirty());
+
+	Plant plant2;
+	plant2.setDefault();
+	PatternGenerator generator2(&plant2);
+	generator2.setParameterTree(changedTree);
+	generator2.grow();
+	int count = 0;
+	BOOST_TEST(compareTrees(root, plant2.getRoot(), count));
+	BOOST_TEST(count > 50);
+	Stem *stem = root->getChild();
+	for (size_t i = 0; i < stems.size(); i++) {
+		BOOST_TEST(stem == stems[i]);
+		stem = stem->getSibling();
+	}
+
+	changedTree.addChild("1.1.1");
+	root->setParameterTree(changedTree);
+	BOOST_TEST(!generator1.update(root));
+}
+
+BOOST_AUTO_TEST_CASE(test_variants)
+{
+	using Variant = VariantGenerator::Variant;
+	ParameterTree tree;
+	initializeTree(tree);
+	VariantGenerator generator1(tree);
+	VariantGenerator generator2(tree);
+	generator2.setThreads(3);
+	for (int seed = 1; seed <= 4; seed++) {
+		generator1.addSeed(seed);
+		generator2.addSeed(seed);
+	}
+	std::vector<Variant> variants1 = generator1.generate();
+	std::vector<Variant> variants2 = generator2.generate();
+	BOOST_TEST(variants1.size() == 4);
+	BOOST_TEST(variants2.size() == 4);
+
+	for (int seed = 1; seed <= 4; seed++) {
+		ParameterTree seedTree = tree;
+		StemData data = seedTree.getRoot()->getData();
+		data.seed = seed;
+		seedTree.getRoot()->setData(data);
+		Plant plant;
+		plant.setDefault();
+		PatternGenerator pattern(&plant);
+		pattern.setParameterTree(seedTree);
+		pattern.grow();
+		MeshGenerator meshGenerator(&plant);
+		const Mesh &mesh = meshGenerator.generate();
+		std::vector<DVertex> vertices = mesh.getVertices();
+
+		for (auto *variants : {&variants1, &variants2}) {
+			const Variant &variant = (*variants)[seed-1];
+			BOOST_TEST(variant.indices == mesh.getIndices());
+			BOOST_TEST(variant.vertices.size() == vertices.size());
+			bool equal = true;
+			for (size_t i = 0; i < vertices.size() && equal; i++) {
+				Vec3 a = vertices[i].position;
+				Vec3 b = variant.vertices[i].position;
+				equal = a == b;
+			}
+			BOOST_TEST(equal);
+		}
+	}
+	size_t size = variants1[0].vertices.size();
+	BOOST_TEST(size != variants1[1].vertices.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
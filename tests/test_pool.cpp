@@ -54,6 +54,119 @@ BOOST_AUTO_TEST_CASE(test_same_address)
 	BOOST_TEST(stem1 == pool.allocate());
 }
 
+BOOST_AUTO_TEST_CASE(test_deallocate_several)
+{
+	StemPool pool;
+	std::vector<Stem *> stems;
+	for (int i = 0; i < PG_POOL_SIZE + 2; i++)
+		stems.push_back(pool.allocate());
+	long id1 = pool.getPoolID(stems[0]);
+	long id2 = pool.getPoolID(stems.back());
+	pool.deallocate({stems[1], stems.back(), stems[0]});
+	BOOST_TEST(pool.getRemaining(id1) == 2);
+	BOOST_TEST(pool.getRemaining(id2) == PG_POOL_SIZE - 1);
+	BOOST_TEST(pool.allocate() == stems[0]);
+	BOOST_TEST(pool.allocate() == stems.back());
+	BOOST_TEST(pool.allocate() == stems[1]);
+}
+
+BOOST_AUTO_TEST_CASE(test_capacity)
+{
+	StemPool pool(8);
+	std::vector<Stem *> stems;
+	for (int i = 0; i < 20; i++)
+		stems.push_back(pool.allocate());
+	StemPool::Occupancy occupancy = pool.getOccupancy();
+	BOOST_TEST(occupancy.pools == 3);
+	BOOST_TEST(occupancy.emptyPools == 0);
+	BOOST_TEST(occupancy.allocated == 20);
+	BOOST_TEST(occupancy.capacity == 24);
+	BOOST_TEST(occupancy.bytes >= 24 * sizeof(Stem));
+
+	pool.deallocate(std::vector<Stem *>(stems.begin(), stems.begin() + 8));
+	occupancy = pool.getOccupancy();
+	BOOST_TEST(occupancy.emptyPools == 1);
+	BOOST_TEST(occupancy.allocated == 12);
+
+	pool.setPoolCapacity(4);
+	for (int i = 0; i < 12; i++)
+		pool.allocate();
+	Stem *stem = pool.allocate();
+	BOOST_TEST(pool.getPoolID(stem) == 4);
+	BOOST_TEST(pool.getRemaining(4) == 3);
+	BOOST_TEST(pool.getOccupancy().capacity == 28);
+}
+
+BOOST_AUTO_TEST_CASE(test_delete_stems)
+{
+	Plant plant;
+	Stem *root = plant.createRoot();
+	Stem *stem1 = plant.addStem(root);
+	Stem *stem2 = plant.addStem(root);
+	Stem *stem3 = plant.addStem(root);
+	Stem *stem4 = plant.addStem(stem1);
+	plant.deleteStems({stem3, stem1});
+	BOOST_TEST(root->getChild() == stem2);
+	BOOST_TEST(stem2->getSibling() == nullptr);
+	BOOST_TEST(plant.addStem(root) == stem1);
+	BOOST_TEST(plant.addStem(root) == stem4);
+	BOOST_TEST(plant.addStem(root) == stem3);
+}
+
+void getStems(Stem *stem, std::vector<Stem *> &stems)
+{
+	while (stem) {
+		stems.push_back(stem);
+		getStems(stem->getChild(), stems);
+		stem = stem->getSibling();
+	}
+}
+
+BOOST_AUTO_TEST_CASE(test_compact)
+{
+	Plant plant;
+	Stem *root = plant.createRoot();
+	std::vector<Stem *> branches;
+	float id = 0.0f;
+	for (int i = 0; i < 30; i++) {
+		Stem *branch = plant.addStem(root);
+		branch->setMaxRadius(id++);
+		for (int j = 0; j < 10; j++)
+			plant.addStem(branch)->setMaxRadius(id++);
+		branches.push_back(branch);
+	}
+	plant.deleteStems(std::vector<Stem *>(branches.begin() + 5,
+		branches.begin() + 25));
+	std::vector<Stem *> stems;
+	getStems(plant.getRoot(), stems);
+	std::vector<float> radii;
+	for (Stem *stem : stems)
+		radii.push_back(stem->getMaxRadius());
+
+	BOOST_TEST(plant.getStemPool()->getPoolCount() == 4);
+	size_t bytes = plant.getStemPool()->getOccupancy().bytes;
+	BOOST_TEST(plant.compact() == bytes / 2);
+	BOOST_TEST(plant.getStemPool()->getPoolCount() == 2);
+	stems.clear();
+	getStems(plant.getRoot(), stems);
+	BOOST_TEST(stems.size() == radii.size());
+	for (size_t i = 0; i < stems.size(); i++) {
+		Stem *stem = stems[i];
+		BOOST_TEST(stem->getMaxRadius() == radii[i]);
+		if (i % PG_POOL_SIZE > 0)
+			BOOST_TEST(stem == stems[i-1] + 1);
+		Stem *child = stem->getChild();
+		for (; child; child = child->getSibling())
+			BOOST_TEST(child->getParent() == stem);
+	}
+	BOOST_TEST(plant.getStemPool()->getPoolID(stems.back()) == 2);
+
+	Stem *branch = plant.getRoot()->getChild()->getSibling();
+	Stem *sibling = branch->getSibling();
+	plant.deleteStem(branch);
+	BOOST_TEST(plant.getRoot()->getChild()->getSibling() == sibling);
+}
+
 BOOST_AUTO_TEST_CASE(test_last_stem_is_first)
 {
 	Plant plant;
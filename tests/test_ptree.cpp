@@ -3,6 +3,9 @@
 
 #include "../plant_generator/parameter_tree.h"
 #include <algorithm>
+#include <sstream>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
 
 using namespace pg;
 namespace bt = boost::unit_test;
@@ -142,4 +145,75 @@ BOOST_AUTO_TEST_CASE(test_remove_first_sibling)
 	BOOST_TEST(!node->getChild()->getPrevSibling());
 }
 
+BOOST_AUTO_TEST_CASE(test_copy_on_write)
+{
+	ParameterTree tree;
+	tree.createRoot();
+	tree.addChild("");
+	tree.addChild("1");
+	ParameterTree treeCopy = tree;
+	const ParameterTree &constTree = tree;
+	const ParameterTree &constCopy = treeCopy;
+	BOOST_TEST(tree.isShared());
+	BOOST_TEST(constTree.getRoot() == constCopy.getRoot());
+	BOOST_TEST(constTree.get("1.1") == constCopy.get("1.1"));
+
+	treeCopy.updateField([](StemData *data) {
+		data->maxDepth = 5;
+	}, "1.1");
+	BOOST_TEST(!tree.isShared());
+	BOOST_TEST(!treeCopy.isShared());
+	BOOST_TEST(constTree.getRoot() != constCopy.getRoot());
+	BOOST_TEST(constTree.get("1.1")->getData().maxDepth != 5);
+	BOOST_TEST(constCopy.get("1.1")->getData().maxDepth == 5);
+	BOOST_TEST(constCopy.get("1.1")->getParent() == constCopy.get("1"));
+
+	treeCopy = tree;
+	treeCopy.addSibling("1");
+	BOOST_TEST(tree.getNames().size() == 2);
+	BOOST_TEST(treeCopy.getNames().size() == 3);
+
+	treeCopy = tree;
+	treeCopy.clean();
+	BOOST_TEST(!tree.isShared());
+	BOOST_TEST(constTree.getRoot()->isDirty());
+	BOOST_TEST(!constCopy.getRoot()->isDirty());
+	tree = treeCopy;
+	tree.clean();
+	BOOST_TEST(tree.isShared());
+
+	treeCopy.updateField([](StemData *data) {
+		data->maxDepth = 5;
+	}, "1.2");
+	BOOST_TEST(!treeCopy.get("1.2"));
+	BOOST_TEST(tree.isShared());
+}
+
+BOOST_AUTO_TEST_CASE(test_serialize_shared)
+{
+	ParameterTree tree1;
+	tree1.createRoot();
+	tree1.addChild("");
+	tree1.addChild("1");
+	ParameterTree tree2 = tree1;
+
+	std::stringstream stream;
+	{
+		boost::archive::text_oarchive oa(stream);
+		oa << tree1;
+		oa << tree2;
+	}
+	ParameterTree tree3;
+	ParameterTree tree4;
+	{
+		boost::archive::text_iarchive ia(stream);
+		ia >> tree3;
+		ia >> tree4;
+	}
+	const ParameterTree &constTree = tree3;
+	BOOST_TEST(tree3.isShared());
+	BOOST_TEST(constTree.get("1.1")->getParent() == constTree.get("1"));
+	BOOST_TEST(tree4.getNames().size() == 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,69 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+
+#include "../plant_generator/snapshot.h"
+
+using namespace pg;
+namespace bt = boost::unit_test;
+
+BOOST_AUTO_TEST_SUITE(snapshot)
+
+BOOST_AUTO_TEST_CASE(test_stems)
+{
+	Plant plant;
+	plant.setDefault();
+	Stem *root = plant.createRoot();
+	Path path;
+	Spline spline;
+	spline.setDegree(1);
+	spline.addControl(Vec3(0.0f, 0.0f, 0.0f));
+	spline.addControl(Vec3(0.0f, 4.0f, 0.0f));
+	spline.addControl(Vec3(1.0f, 10.0f, 0.0f));
+	path.setSpline(spline);
+	root->setPath(path);
+	root->setMaxRadius(1.0f);
+	Stem *stem1 = plant.addStem(root);
+	Stem *stem2 = plant.addStem(root);
+	Stem *stem3 = plant.addStem(stem2);
+	for (Stem *stem : {stem1, stem2, stem3}) {
+		stem->setPath(path);
+		stem->setMaxRadius(0.5f);
+		stem->setDistance(2.0f);
+	}
+	Leaf leaf;
+	leaf.setPosition(3.0f);
+	stem3->addLeaf(leaf);
+
+	Snapshot snapshot(&plant);
+	BOOST_TEST(snapshot.getStemCount() == 4);
+	std::vector<const Stem *> stems = {root, stem2, stem3, stem1};
+	BOOST_TEST(snapshot.getStems() == stems);
+	BOOST_TEST(snapshot.getParents() == std::vector<int>({-1, 0, 1, 0}));
+	BOOST_TEST(snapshot.getDepths() == std::vector<int>({0, 1, 2, 1}));
+	const std::vector<size_t> &offsets = snapshot.getPointOffsets();
+	BOOST_TEST(offsets.size() == 5);
+	BOOST_TEST(offsets.back() == snapshot.getPoints().size());
+	BOOST_TEST(snapshot.getRadii().size() == snapshot.getPoints().size());
+	for (size_t i = 0; i < stems.size(); i++) {
+		Stem *stem = const_cast<Stem *>(stems[i]);
+		for (size_t j = offsets[i]; j < offsets[i+1]; j++) {
+			size_t k = j - offsets[i];
+			Vec3 point = stem->getPath().get(k);
+			point += stem->getLocation();
+			BOOST_TEST(snapshot.getPoints()[j] == point);
+			float radius = plant.getRadius(stem, k);
+			BOOST_TEST(snapshot.getRadii()[j] == radius);
+		}
+	}
+	std::vector<size_t> leafOffsets = {0, 0, 0, 1, 1};
+	BOOST_TEST(snapshot.getLeafOffsets() == leafOffsets);
+	const Path &stemPath = stem3->getPath();
+	Vec3 location = stem3->getLocation() + stemPath.getIntermediate(3.0f);
+	BOOST_TEST(snapshot.getLeafLocations()[0] == location);
+
+	plant.deleteStem(stem2);
+	BOOST_TEST(snapshot.getStemCount() == 4);
+	BOOST_TEST(Snapshot(&plant).getStemCount() == 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
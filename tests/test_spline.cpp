@@ -2,6 +2,9 @@
 #include <boost/test/unit_test.hpp>
 
 #include "../plant_generator/spline.h"
+#include <sstream>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
 
 using namespace pg;
 namespace bt = boost::unit_test;
@@ -101,4 +104,54 @@ BOOST_AUTO_TEST_CASE(test_parallelize_linear)
 	BOOST_TEST(controls[1] == spline.getControls()[1]);
 }
 
+BOOST_AUTO_TEST_CASE(test_compile)
+{
+	Spline spline(0);
+	Spline exact = spline;
+	spline.compile(0.0001f);
+	BOOST_TEST(spline.isCompiled());
+	for (int i = 0; i <= 1000; i++) {
+		float t = i / 1000.0f;
+		Vec3 difference = spline.getPoint(t) - exact.getPoint(t);
+		BOOST_TEST(magnitude(difference) < 0.0002f);
+	}
+	BOOST_TEST(spline.getPoint(2.0f) == exact.getPoint(2.0f));
+	BOOST_TEST(spline.getPoint(-1.0f) == exact.getPoint(-1.0f));
+	BOOST_TEST(exact.getPoint(-1.0f) == exact.getControls().front());
+	/* Values just outside of the curve are clamped to its ends. */
+	Vec3 front = spline.getControls().front();
+	Vec3 back = spline.getControls().back();
+	BOOST_TEST(magnitude(spline.getPoint(-0.001f) - front) < 0.0002f);
+	BOOST_TEST(magnitude(spline.getPoint(1.001f) - back) < 0.0002f);
+
+	Spline copy = spline;
+	BOOST_TEST(copy.isCompiled());
+	spline.move(1, Vec3(0.0f, 0.5f, 0.0f), false);
+	BOOST_TEST(!spline.isCompiled());
+	BOOST_TEST(copy.isCompiled());
+
+	std::vector<Vec3> controls;
+	controls.push_back(Vec3(0.0f, 0.0f, 0.0f));
+	controls.push_back(Vec3(0.3f, 1.0f, 0.0f));
+	controls.push_back(Vec3(1.0f, 0.0f, 0.0f));
+	spline.setDegree(1);
+	spline.setControls(controls);
+	spline.compile(0.000001f);
+	BOOST_TEST(!spline.isCompiled());
+	BOOST_TEST(spline.getPoint(0.3f) == controls[1]);
+
+	std::stringstream stream;
+	{
+		boost::archive::text_oarchive oa(stream);
+		oa << copy;
+	}
+	BOOST_TEST(copy.isCompiled());
+	{
+		boost::archive::text_iarchive ia(stream);
+		ia >> copy;
+	}
+	BOOST_TEST(!copy.isCompiled());
+	BOOST_TEST(copy.getPoint(0.5f) == exact.getPoint(0.5f));
+}
+
 BOOST_AUTO_TEST_SUITE_END()